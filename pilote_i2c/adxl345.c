@@ -5,219 +5,3790 @@
 #include <linux/i2c.h>
 #include <linux/miscdevice.h>  // Inclure le framework misc
 #include <linux/fs.h>
+#include <linux/uio.h>
 #include <linux/ioctl.h>
-#include <linux/kfifo.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
 #include <linux/wait.h>
 #include <linux/interrupt.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/property.h>
+#include <linux/device.h>
+#include <linux/sysfs.h>
+#include <linux/rwsem.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/regmap.h>
+#include <linux/pm.h>
+#include <linux/pm_runtime.h>
+#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+#include <linux/seqlock.h>
+#include <asm/ioctls.h>
+
+#define CREATE_TRACE_POINTS
+#include "adxl345_trace.h"
 
 #define ADXL345_IOC_MAGIC 'a'
-#define ADXL345_SET_AXIS _IOW(ADXL345_IOC_MAGIC, 1, int)
+#define ADXL345_SET_AXIS _IOW(ADXL345_IOC_MAGIC, 1, int)    // 0 = X, 1 = Y, 2 = Z
+#define ADXL345_MMAP_WAIT _IO(ADXL345_IOC_MAGIC, 2)
+#define ADXL345_SET_FORMAT _IOW(ADXL345_IOC_MAGIC, 3, int)
+#define ADXL345_SET_RATE _IOW(ADXL345_IOC_MAGIC, 4, int)
+#define ADXL345_SET_RANGE _IOW(ADXL345_IOC_MAGIC, 5, int)
+#define ADXL345_SET_FULL_RES _IOW(ADXL345_IOC_MAGIC, 6, int)
+#define ADXL345_SET_WATERMARK _IOW(ADXL345_IOC_MAGIC, 7, int)
+#define ADXL345_GET_CONFIG _IOR(ADXL345_IOC_MAGIC, 8, struct adxl345_config)
+#define ADXL345_SET_RING_SIZE _IOW(ADXL345_IOC_MAGIC, 9, int)
+#define ADXL345_GET_OVERRUNS _IOR(ADXL345_IOC_MAGIC, 10, struct adxl345_overruns)
+#define ADXL345_SET_FILTER _IOW(ADXL345_IOC_MAGIC, 11, struct adxl345_filter)
+#define ADXL345_GET_FILTER _IOR(ADXL345_IOC_MAGIC, 12, struct adxl345_filter)
+#define ADXL345_SET_AXES _IOW(ADXL345_IOC_MAGIC, 13, int)   // ADXL345_AXIS_*
+#define ADXL345_SET_EVENTS _IOW(ADXL345_IOC_MAGIC, 14, struct adxl345_events_config)
+#define ADXL345_GET_EVENTS _IOR(ADXL345_IOC_MAGIC, 15, struct adxl345_events_config)
+#define ADXL345_SET_CAPTURE _IOW(ADXL345_IOC_MAGIC, 16, struct adxl345_capture_config)
+#define ADXL345_GET_CAPTURE _IOR(ADXL345_IOC_MAGIC, 17, struct adxl345_capture_config)
+#define ADXL345_SET_LOWAT _IOW(ADXL345_IOC_MAGIC, 18, struct adxl345_lowat)
+#define ADXL345_GET_QUEUE_STATE _IOR(ADXL345_IOC_MAGIC, 19, struct adxl345_queue_state)
+#define ADXL345_GET_LATEST _IOR(ADXL345_IOC_MAGIC, 20, struct adxl345_sample_ext)
+
+// Formats d'enregistrement retournés par read()
+#define ADXL345_FORMAT_RAW          0   // struct adxl345_sample
+#define ADXL345_FORMAT_EXT          1   // struct adxl345_sample_ext
+#define ADXL345_FORMAT_PACKED       2   // int16 par axe sélectionné, dans l'ordre X, Y, Z
+#define ADXL345_FORMAT_EVENTS       3   // struct adxl345_event (file des événements)
+#define ADXL345_FORMAT_CAPTURE      4   // struct adxl345_capture (captures déclenchées)
+
+// Axes retenus par ADXL345_FORMAT_PACKED
+#define ADXL345_AXIS_X              0x1
+#define ADXL345_AXIS_Y              0x2
+#define ADXL345_AXIS_Z              0x4
+#define ADXL345_AXIS_ALL            0x7
+
+// Politique appliquée quand l'anneau est plein pour le lecteur le plus lent
+#define ADXL345_OVERRUN_OVERWRITE   0   // Écraser les plus anciens (par défaut)
+#define ADXL345_OVERRUN_DROP_NEWEST 1   // Jeter les échantillons entrants
+#define ADXL345_OVERRUN_BACKPRESSURE 2  // Suspendre la FIFO matérielle
+
+#define ADXL345_REG_DEVID           0x00
+#define ADXL345_REG_THRESH_TAP      0x1D
+#define ADXL345_REG_OFSX            0x1E
+#define ADXL345_REG_OFSY            0x1F
+#define ADXL345_REG_OFSZ            0x20
+#define ADXL345_REG_DUR             0x21
+#define ADXL345_REG_LATENT          0x22
+#define ADXL345_REG_WINDOW          0x23
+#define ADXL345_REG_THRESH_ACT      0x24
+#define ADXL345_REG_THRESH_INACT    0x25
+#define ADXL345_REG_TIME_INACT      0x26
+#define ADXL345_REG_ACT_INACT_CTL   0x27
+#define ADXL345_REG_THRESH_FF       0x28
+#define ADXL345_REG_TIME_FF         0x29
+#define ADXL345_REG_TAP_AXES        0x2A
+#define ADXL345_REG_ACT_TAP_STATUS  0x2B
+#define ADXL345_REG_BW_RATE         0x2C
+#define ADXL345_REG_POWER_CTL       0x2D
+#define ADXL345_REG_INT_ENABLE      0x2E
+#define ADXL345_REG_INT_MAP         0x2F
+#define ADXL345_REG_INT_SOURCE      0x30
+#define ADXL345_REG_DATA_FORMAT     0x31
+#define ADXL345_REG_DATAX0          0x32
+#define ADXL345_REG_DATAZ1          0x37
+#define ADXL345_REG_FIFO_CTL        0x38
+#define ADXL345_REG_FIFO_STATUS     0x39
+#define ADXL345_POWER_CTL_STANDBY   0x00
+#define ADXL345_POWER_CTL_MEASURE   0x08
+
+// Sources d'interruption (INT_ENABLE, INT_SOURCE)
+#define ADXL345_INT_WATERMARK       0x02
+#define ADXL345_EVENT_SINGLE_TAP    0x40
+#define ADXL345_EVENT_DOUBLE_TAP    0x20
+#define ADXL345_EVENT_ACTIVITY      0x10
+#define ADXL345_EVENT_INACTIVITY    0x08
+#define ADXL345_EVENT_FREE_FALL     0x04
+#define ADXL345_EVENT_MASK          0x7C
+#define ADXL345_FIFO_ENTRIES_MASK   0x3F
+#define ADXL345_FIFO_TRIG           0x80    // FIFO_STATUS : déclenchement reçu (mode trigger)
+#define ADXL345_FIFO_SAMPLES_MASK   0x1F
+#define ADXL345_FIFO_MODE_MASK      0xC0
+#define ADXL345_FIFO_MODE_FIFO      0x40    // FIFO_CTL bits [7:6] = 01 : s'arrête une fois pleine
+#define ADXL345_FIFO_MODE_STREAM    0x80    // FIFO_CTL bits [7:6] = 10
+#define ADXL345_FIFO_MODE_TRIGGER   0xC0    // FIFO_CTL bits [7:6] = 11 : figée par un événement
+#define ADXL345_FIFO_SIZE           32
+#define ADXL345_DATA_FORMAT_FULL_RES 0x08
+#define ADXL345_DATA_FORMAT_RANGE   0x03
+
+// BW_RATE : 3200 Hz pour le code 0xF, fréquence divisée par 2 à chaque pas
+#define ADXL345_RATE_MAX            0x0F
+#define ADXL345_RATE_HZ(rate)       (3200U >> (15 - (rate)))
+#define ADXL345_ODR_PERIOD_NS(rate) (312500ULL << (15 - ((rate) & 0x0F)))
+
+// Configuration par défaut, modifiable par le device tree puis par ioctl
+#define ADXL345_DEFAULT_RATE_HZ     100
+#define ADXL345_DEFAULT_RANGE_G     2
+#define ADXL345_DEFAULT_WATERMARK   20
+
+// Watermark adaptatif : recalcul toutes les ADXL345_ADAPT_PERIOD vidanges
+#define ADXL345_ADAPT_PERIOD        8
+// Marge laissée dans la FIFO matérielle (32 entrées) pour la latence d'IRQ
+#define ADXL345_ADAPT_MAX_WATERMARK 24
+#define ADXL345_DEFAULT_LATENCY_US  50000
+
+// Scrutation : seuil par défaut (interruptions watermark par seconde, 0 : jamais)
+#define ADXL345_DEFAULT_POLL_THRESHOLD_HZ 400
+
+// Flux fusionné : retard toléré entre un front d'interruption et la vidange
+#define ADXL345_MERGE_SLACK_NS      (10 * NSEC_PER_MSEC)
+
+// Mise en veille du capteur après la fermeture du dernier fichier
+#define ADXL345_AUTOSUSPEND_MS      2000
+
+// File des événements, commune aux lecteurs (puissance de 2)
+#define ADXL345_EVENT_RING          64
+// File des captures déclenchées (puissance de 2)
+#define ADXL345_CAPTURE_RING        8
+
+// Histogrammes log2 : l'intervalle b compte les valeurs de [2^(b-1), 2^b)
+#define ADXL345_HIST_BUCKETS        64
+
+// 32 entrées dans la FIFO + l'échantillon des registres de sortie
+#define ADXL345_HW_FIFO_DEPTH       33
+#define ADXL345_DRAIN_MAX_MSGS      (2 * ADXL345_HW_FIFO_DEPTH + 2)
+#define ADXL345_DRAIN_MAX_ROUNDS    4
+
+// Configuration courante du capteur (ADXL345_GET_CONFIG)
+struct adxl345_config {
+    __u32 rate_hz;      // Fréquence de sortie des données
+    __u32 range_g;      // Pleine échelle : 2, 4, 8 ou 16 g
+    __u32 full_res;     // 1 : résolution 4 mg/LSB quelle que soit la plage
+    __u32 watermark;    // Seuil d'interruption de la FIFO (1 à 31)
+    __u32 ring_entries; // Profondeur de l'anneau logiciel (puissance de 2)
+};
+
+struct adxl345_sample {
+    int16_t x;  // Valeur pour l'axe X
+    int16_t y;  // Valeur pour l'axe Y
+    int16_t z;  // Valeur pour l'axe Z
+};
+
+/*
+ * Enregistrement étendu, tel qu'il est stocké dans l'anneau. Pour read() et
+ * mmap(), seq est l'index dans l'anneau, après filtrage et pertes. Pour
+ * ADXL345_GET_LATEST, c'est l'index parmi les échantillons mesurés en flux,
+ * avant filtrage : les deux séries ne se comparent pas.
+ */
+struct adxl345_sample_ext {
+    __s64 timestamp;    // Instant de mesure (ns, CLOCK_MONOTONIC)
+    __u32 seq;          // Index de l'échantillon (voir ci-dessus)
+    __s16 x;
+    __s16 y;
+    __s16 z;
+    __u16 flags;        // ADXL345_SAMPLE_*
+    __u32 reserved;
+};
+
+// Des échantillons ont été perdus juste avant celui-ci
+#define ADXL345_SAMPLE_OVERRUN      0x0001
+// Flux fusionné : remis après un échantillon plus récent (capteur en retard)
+#define ADXL345_SAMPLE_LATE         0x0002
+// ADXL345_GET_LATEST : FIFO figée (capture, backpressure), plus récent inaccessible
+#define ADXL345_SAMPLE_STALE        0x0004
+
+/*
+ * Enregistrement du flux fusionné (/dev/adxl345-all) : les échantillons de
+ * tous les capteurs, par horodatage croissant, marqués de leur origine.
+ */
+struct adxl345_sample_merged {
+    __s64 timestamp;
+    __u32 seq;          // Index de l'échantillon dans le flux de son capteur
+    __s16 x;
+    __s16 y;
+    __s16 z;
+    __u16 flags;        // ADXL345_SAMPLE_*
+    __u32 source;       // N de /dev/adxl345-N
+};
+
+// État des files, sans rien consommer (ADXL345_GET_QUEUE_STATE)
+#define ADXL345_QUEUE_OVERRUN       0x01    // Pertes pour ce fichier depuis sa dernière lecture
+#define ADXL345_QUEUE_PAUSED        0x02    // FIFO matérielle suspendue (backpressure)
+#define ADXL345_QUEUE_POLLING       0x04    // FIFO vidée par scrutation
+#define ADXL345_QUEUE_TRIGGERED     0x08    // Capture en cours (FIFO_STATUS FIFO_TRIG)
+
+struct adxl345_queue_state {
+    __u32 pending;          // Échantillons lisibles par ce fichier dans l'anneau
+    __u32 bytes;            // Octets lisibles au format courant (FIONREAD)
+    __u32 hw_entries;       // Entrées de la FIFO matérielle (FIFO_STATUS)
+    __u32 flags;            // ADXL345_QUEUE_*
+    __u32 events_pending;   // Événements non lus par ce fichier
+    __u32 captures_pending; // Captures non lues par ce fichier
+    __u64 lost;             // Perdus par ce fichier (comme ADXL345_GET_OVERRUNS)
+    struct adxl345_config config;
+};
+
+// Seuil de réveil propre au fichier (ADXL345_SET_LOWAT)
+struct adxl345_lowat {
+    __u32 samples;      // Échantillons en attente avant réveil, 0 : read_min_samples
+    __u32 timeout_ms;   // Âge du plus ancien au-delà duquel réveiller quand même, 0 : aucun
+};
+
+// Compteurs de pertes (ADXL345_GET_OVERRUNS)
+struct adxl345_overruns {
+    __u64 dropped;      // Jetés par le pilote, jamais entrés dans l'anneau
+    __u64 overwritten;  // Écrasés avant lecture, tous lecteurs confondus
+    __u64 lost;         // Perdus par ce fichier, quelle qu'en soit la cause
+};
+
+/*
+ * Détecteurs matériels (ADXL345_SET_EVENTS). Les seuils et durées sont
+ * écrits tels quels dans les registres correspondants (voir la datasheet
+ * pour les unités).
+ */
+struct adxl345_events_config {
+    __u32 enable;           // ADXL345_EVENT_*
+    __u8 thresh_tap;        // THRESH_TAP, 62,5 mg/LSB
+    __u8 tap_duration;      // DUR, 625 µs/LSB
+    __u8 tap_latency;       // LATENT, 1,25 ms/LSB
+    __u8 tap_window;        // WINDOW, 1,25 ms/LSB
+    __u8 tap_axes;          // TAP_AXES
+    __u8 thresh_act;        // THRESH_ACT, 62,5 mg/LSB
+    __u8 thresh_inact;      // THRESH_INACT, 62,5 mg/LSB
+    __u8 time_inact;        // TIME_INACT, 1 s/LSB
+    __u8 act_inact_ctl;     // ACT_INACT_CTL
+    __u8 thresh_ff;         // THRESH_FF, 62,5 mg/LSB
+    __u8 time_ff;           // TIME_FF, 5 ms/LSB
+    __u8 reserved;
+};
+
+// Enregistrement retourné par read() en ADXL345_FORMAT_EVENTS
+struct adxl345_event {
+    __s64 timestamp;        // Front de l'interruption (ns, CLOCK_MONOTONIC)
+    __u32 seq;              // Index dans la file des événements
+    __u8 source;            // ADXL345_EVENT_* déclenchés
+    __u8 act_tap_status;    // ACT_TAP_STATUS : axes à l'origine de l'événement
+    __u16 reserved;
+};
+
+/*
+ * Capture déclenchée (ADXL345_SET_CAPTURE). Un des événements de trigger
+ * fige une fenêtre de ADXL345_FIFO_SIZE échantillons, dont pre_samples
+ * antérieurs au déclenchement, remise d'un bloc en ADXL345_FORMAT_CAPTURE.
+ * Sans ADXL345_CAPTURE_STREAM, la FIFO matérielle passe en mode trigger et
+ * le flux continu est arrêté : le bus n'est sollicité qu'à chaque capture.
+ * Avec, le flux continue et la fenêtre est prélevée au passage.
+ */
+#define ADXL345_CAPTURE_STREAM      0x1
+
+struct adxl345_capture_config {
+    __u32 trigger;      // ADXL345_EVENT_* déclencheurs, 0 : capture désactivée
+    __u32 pre_samples;  // Échantillons gardés avant le déclenchement (1 à 31)
+    __u32 flags;        // ADXL345_CAPTURE_*
+};
+
+// Enregistrement retourné par read() en ADXL345_FORMAT_CAPTURE
+struct adxl345_capture {
+    __s64 timestamp;        // Instant de mesure de samples[0] (ns, CLOCK_MONOTONIC)
+    __s64 trigger;          // Front de l'interruption de déclenchement
+    __u64 period_ns;        // samples[i] est mesuré à timestamp + i * period_ns
+    __u32 seq;              // Index dans la file des captures
+    __u8 source;            // ADXL345_EVENT_* à l'origine de la capture
+    __u8 act_tap_status;    // ACT_TAP_STATUS au déclenchement
+    __u8 pre_samples;       // Échantillons antérieurs au déclenchement
+    __u8 count;             // Échantillons valides dans samples
+    struct adxl345_sample samples[ADXL345_FIFO_SIZE];
+};
+
+// Traitement appliqué entre la vidange et l'anneau (ADXL345_SET_FILTER)
+#define ADXL345_FILTER_NONE         0
+#define ADXL345_FILTER_MOVING_AVG   1   // Moyenne des taps derniers échantillons
+#define ADXL345_FILTER_BOXCAR       2   // CIC d'ordre 1 : moyenne par bloc de decimation
+#define ADXL345_FILTER_FIR          3   // Somme des coeffs[k] * x[n - k], >> shift
+#define ADXL345_FILTER_MAX_TAPS     32
+#define ADXL345_FILTER_MAX_DECIMATION 1024
+
+struct adxl345_filter {
+    __u32 type;         // ADXL345_FILTER_*
+    __u32 decimation;   // Un échantillon produit pour decimation reçus (1 à 1024)
+    __u32 taps;         // Longueur de la moyenne ou du FIR
+    __u32 shift;        // FIR : coefficients en virgule fixe Q(shift)
+    __s16 coeffs[ADXL345_FILTER_MAX_TAPS];
+};
+
+/*
+ * En-tête partagé avec l'espace utilisateur via mmap() sur /dev/adxl345-N.
+ * Chaque fichier ouvert a sa propre page d'en-tête (offset 0, PROT_WRITE
+ * pour tail). L'anneau de diffusion commun à tous les lecteurs se projette
+ * à part, en lecture seule, à l'offset data_offset. Le pilote
+ * avance head après avoir écrit les échantillons, le consommateur avance
+ * tail après les avoir lus ; l'anneau est vide quand head == tail. Les
+ * index sont libres (modulo 2^32), l'entrée correspondante est
+ * index & (size - 1). Si head - tail dépasse size, les plus anciens
+ * échantillons ont été écrasés : le consommateur repart de head - size.
+ * Une entrée d'index i n'est valide que si son champ seq vaut i avant et
+ * après la copie (sinon le pilote était en train de la réécrire).
+ */
+struct adxl345_mmap_header {
+    __u32 version;
+    __u32 record_size;  // sizeof(struct adxl345_sample_ext)
+    __u32 size;         // Nombre d'entrées (puissance de 2)
+    __u32 data_offset;  // Début des échantillons depuis le début du mapping
+    __u32 head;         // Index producteur, écrit par le pilote
+    __u32 tail;         // Index consommateur, écrit par l'utilisateur
+    __u32 dropped;      // Échantillons écrasés avant d'être lus
+};
+
+#define ADXL345_MMAP_VERSION        4
+#define ADXL345_RING_ENTRIES        1024
+// Bornes de la profondeur de l'anneau (arrondie à la puissance de 2 supérieure)
+#define ADXL345_RING_MIN_ENTRIES    64
+#define ADXL345_RING_MAX_ENTRIES    (1 << 20)
+// Plus grand lot écrit avant publication de head (une passe de vidange)
+#define ADXL345_RING_MAX_BATCH      ADXL345_HW_FIFO_DEPTH
+// Enregistrements copiés par passe dans read(), via un tampon sur la pile
+#define ADXL345_READ_CHUNK          16
+
+struct adxl345_hist {
+    atomic64_t bucket[ADXL345_HIST_BUCKETS];
+};
+
+// Statistiques exposées dans debugfs (adxl345-N/)
+struct adxl345_stats {
+    atomic64_t irqs;
+    atomic64_t drained;         // Échantillons sortis de la FIFO matérielle
+    atomic64_t delivered;       // Échantillons remis par read()
+    atomic64_t i2c_errors;
+    atomic64_t events;
+    atomic64_t captures;
+    atomic64_t polls;
+    struct adxl345_hist irq_latency;    // Front d'interruption -> début de vidange (ns)
+    struct adxl345_hist i2c_time;       // Durée d'un i2c_transfer de vidange (ns)
+    struct adxl345_hist fifo_entries;   // Occupation de la FIFO à l'interruption
+    struct adxl345_hist wakeup_latency; // wake_up() -> lecteur réveillé (ns)
+};
+
+struct adxl345_device
+{
+    struct miscdevice miscdev;
+    struct list_head node;      // Dans adxl345_devices
+    int index;                  // N de /dev/adxl345-N
+    /*
+     * Anneau de diffusion des échantillons, sans verrou. La vidange est le
+     * seul producteur : elle écrit un lot puis publie head (release). Chaque
+     * fichier ouvert a son propre curseur, si bien que tous les lecteurs
+     * voient tous les échantillons ; un lecteur trop lent est écrasé, jamais
+     * attendu. Les threads qui partagent un même fichier se partagent son
+     * curseur : chaque échantillon est remis à un seul d'entre eux
+     * (réservation par cmpxchg), dans l'ordre des réservations.
+     */
+    struct adxl345_sample_ext *ring;   // vmalloc_user, projeté par mmap()
+    size_t ring_bytes;
+    u32 ring_size;                 // Nombre d'entrées (puissance de 2)
+    struct rw_semaphore ring_sem;  // Lecture : accès à ring ; écriture : redimensionnement
+    u32 head;                      // Index producteur
+    struct list_head readers;      // Fichiers ouverts, parcourus sous RCU
+    struct mutex readers_lock;     // Ajout/retrait de lecteurs, mmap()
+    wait_queue_head_t wait_queue;  // File d'attente pour les processus en sommeil
+    /*
+     * Fichiers ouverts au-delà du retrait : chacun tient une référence,
+     * rendue au dernier close() (adxl345_dev_free). Les opérations sur un
+     * fichier tiennent remove_sem en lecture ; adxl345_remove() la prend
+     * en écriture après avoir marqué dead, et plus rien ne touche ensuite
+     * au capteur depuis un fichier.
+     */
+    struct kref ref;
+    struct rw_semaphore remove_sem;
+    bool dead;
+    struct fasync_struct *async_queue; // Lecteurs notifiés par SIGIO
+
+    // Vidange groupée de la FIFO matérielle (un seul i2c_transfer par lot)
+    struct i2c_msg drain_msgs[ADXL345_DRAIN_MAX_MSGS];
+    u8 drain_data[ADXL345_HW_FIFO_DEPTH][6];
+    struct adxl345_sample_ext drain_samples[ADXL345_HW_FIFO_DEPTH];
+    struct regmap *regmap;      // Registres de configuration en cache (REGCACHE_FLAT)
+    u8 reg_datax0;
+    u8 reg_fifo_status;
+    u8 fifo_status;
+    unsigned int fifo_hint; // Entrées restantes vues au dernier FIFO_STATUS
+
+    // Horodatage : front du watermark capturé dans le gestionnaire primaire
+    s64 irq_timestamp;
+    s64 last_timestamp;         // Horodatage du dernier échantillon vidé
+    struct adxl345_sample_ext latest;   // Dernier échantillon vidé, avant filtrage
+    seqcount_t latest_seq;              // Un seul écrivain : la vidange
+    u32 measured;               // Échantillons vidés en flux, index de latest.seq
+    u64 odr_period_ns;          // Période d'échantillonnage configurée
+    unsigned int watermark;     // Seuil programmé dans FIFO_CTL
+
+    // Copie des registres de configuration, modifiés sous config_lock
+    struct mutex config_lock;
+    u8 bw_rate;
+    u8 data_format;
+    u8 fifo_ctl;
+
+    // Anneau plein : politique et comptabilité des pertes
+    int overrun_policy;         // ADXL345_OVERRUN_*
+    bool paused;                // FIFO matérielle suspendue (backpressure)
+    bool gap;                   // Marquer le prochain échantillon publié
+    atomic64_t dropped;
+    atomic64_t overwritten;
+
+    // Filtrage et décimation, modifiés sous config_lock interruption masquée
+    struct adxl345_filter filter;
+    struct {
+        s16 hist[3][ADXL345_FILTER_MAX_TAPS]; // Derniers échantillons reçus
+        unsigned int pos;                       // Index du plus récent
+        unsigned int fill;                      // Entrées valides dans hist
+        unsigned int phase;                     // Reçus depuis la dernière sortie
+        s32 acc[3];                             // Somme du bloc (BOXCAR)
+    } filter_state;
+
+    // Détecteurs matériels et file des événements (diffusée comme l'anneau)
+    struct adxl345_events_config events;
+    struct adxl345_event event_ring[ADXL345_EVENT_RING];
+    u32 event_head;
+    spinlock_t event_lock;
+
+    /*
+     * Captures déclenchées. La fenêtre est assemblée par le producteur
+     * (vidange, ou capture_work en mode trigger) à partir des derniers
+     * échantillons reçus, puis publiée dans une file diffusée comme celle
+     * des événements.
+     */
+    struct adxl345_capture_config capture;
+    struct {
+        struct adxl345_sample_ext hist[ADXL345_FIFO_SIZE];
+        unsigned int pos;       // Prochaine entrée écrite dans hist
+        unsigned int fill;      // Entrées valides dans hist
+        bool armed;             // Déclenchement reçu, fenêtre en cours
+        bool pending;           // En flux : déclenchement à armer par la vidange
+        unsigned int post;      // Échantillons reçus depuis le déclenchement
+        s64 trigger;
+        u8 source;
+        u8 act_tap_status;
+    } capture_state;
+    struct delayed_work capture_work;   // Lecture de la FIFO figée (mode trigger)
+    struct work_struct resume_work;     // Reprise du flux après une lecture IOCB_NOWAIT
+    struct adxl345_capture capture_ring[ADXL345_CAPTURE_RING];
+    u32 capture_head;
+    spinlock_t capture_lock;
+
+    struct adxl345_stats stats;
+    s64 wake_ns;                // Dernier réveil des lecteurs (adxl345_wake)
+    struct dentry *debugfs;
+
+    // Watermark adaptatif (sysfs adaptive_watermark, latency_budget_us)
+    bool adaptive;
+    u64 latency_budget_ns;
+    unsigned int adapt_count;
+
+    /*
+     * Mode hybride (sysfs poll_threshold_hz) : au-delà du seuil, le
+     * watermark est masqué et la FIFO vidée par poll_work, relancé par
+     * poll_timer. polling est modifié sous config_lock.
+     */
+    unsigned int poll_threshold_hz;
+    bool polling;
+    s64 last_edge;
+    u64 irq_interval_ns;        // Intervalle moyen entre interruptions watermark
+    struct hrtimer poll_timer;
+    struct work_struct poll_work;
+};
+
+// Contexte propre à chaque fichier ouvert (file->private_data)
+struct adxl345_file
+{
+    struct adxl345_device *dev;
+    struct list_head list;      // Dans dev->readers
+    u32 tail;                   // Curseur de lecture dans l'anneau
+    u32 event_tail;             // Curseur dans la file des événements
+    u32 capture_tail;           // Curseur dans la file des captures
+    atomic64_t overruns;        // Échantillons écrasés avant d'être lus
+    bool overrun;               // Perte depuis la dernière lecture
+    bool queue_overrun;         // Idem, file des événements ou des captures
+    bool gap;                   // Marquer le prochain échantillon remis
+    int axes;                   // ADXL345_AXIS_*, pour ADXL345_FORMAT_PACKED
+    int format;                 // ADXL345_FORMAT_*
+    u32 lowat;                  // Seuil de réveil, 0 : read_min_samples
+    u64 lowat_timeout_ns;
+    u64 last_read_ns;           // Cadence de consommation de ce lecteur
+    u64 read_interval_ns;       // (moyenne glissante, 0 si inconnue)
+    struct adxl345_mmap_header *mmap_hdr; // Alloué au premier mmap()
+    wait_queue_head_t poll_wait; // poll(), réveillé seulement si le fichier est prêt
+};
+
+static int adxl345_count = 0;
+
+// Capteurs sondés, fusionnés par /dev/adxl345-all
+static LIST_HEAD(adxl345_devices);
+// Fichiers /dev/adxl345-all ouverts, aussi sous adxl345_devices_lock
+static LIST_HEAD(adxl345_merge_files);
+static DEFINE_MUTEX(adxl345_devices_lock);
+static DECLARE_WAIT_QUEUE_HEAD(adxl345_merge_wait);
+static atomic_t adxl345_merge_gen = ATOMIC_INIT(0);
+
+// Réveille les lecteurs du flux fusionné après une vidange, quel que soit le capteur
+static void adxl345_merge_wake(void)
+{
+    atomic_inc(&adxl345_merge_gen);
+    wake_up(&adxl345_merge_wait);
+}
+
+static void adxl345_hist_add(struct adxl345_hist *h, u64 val)
+{
+    atomic64_inc(&h->bucket[min(fls64(val), ADXL345_HIST_BUCKETS - 1)]);
+}
+
+// Met à jour la cadence de consommation observée pour ce lecteur
+static void adxl345_file_mark_read(struct adxl345_file *ctx)
+{
+    u64 now = ktime_get_ns();
+    u64 last = READ_ONCE(ctx->last_read_ns);
+    u64 interval = READ_ONCE(ctx->read_interval_ns);
+
+    WRITE_ONCE(ctx->last_read_ns, now);
+    if (!last)
+        return;
+    // Moyenne glissante sur environ 8 lectures
+    interval = interval ? interval - (interval >> 3) + ((now - last) >> 3) : now - last;
+    WRITE_ONCE(ctx->read_interval_ns, interval);
+}
+
+static int adxl345_set_rate(struct adxl345_device *dev, u32 hz);
+static int adxl345_set_format(struct adxl345_device *dev, u32 range_g, bool full_res);
+static int adxl345_set_watermark(struct adxl345_device *dev, u32 watermark);
+static int adxl345_set_filter(struct adxl345_device *dev, const struct adxl345_filter *filter);
+static int adxl345_set_events(struct adxl345_device *dev, const struct adxl345_events_config *events);
+static int adxl345_set_capture(struct adxl345_device *dev, const struct adxl345_capture_config *capture);
+static void adxl345_get_config(struct adxl345_device *dev, struct adxl345_config *cfg);
+static void adxl345_resume_stream(struct adxl345_device *dev, bool force);
+static bool adxl345_latest_refresh(struct adxl345_device *dev);
+
+/*
+ * Curseur du lecteur. Une fois le fichier projeté, c'est l'en-tête partagé
+ * qui fait foi puisque le consommateur y avance tail lui-même.
+ */
+static u32 *adxl345_file_cursor(struct adxl345_file *ctx)
+{
+    struct adxl345_mmap_header *hdr = smp_load_acquire(&ctx->mmap_hdr);
+
+    return hdr ? &hdr->tail : &ctx->tail;
+}
+
+// Échantillons en attente pour ce lecteur, écrasés compris
+static u32 adxl345_file_pending(struct adxl345_file *ctx)
+{
+    return smp_load_acquire(&ctx->dev->head) - READ_ONCE(*adxl345_file_cursor(ctx));
+}
+
+static void adxl345_file_lost(struct adxl345_file *ctx, u32 lost)
+{
+    atomic64_add(lost, &ctx->overruns);
+    WRITE_ONCE(ctx->overrun, true);
+    if (ctx->mmap_hdr)
+        WRITE_ONCE(ctx->mmap_hdr->dropped, ctx->mmap_hdr->dropped + lost);
+}
+
+/*
+ * Réserve jusqu'à max échantillons pour ce lecteur et retourne leur nombre,
+ * le premier index réservé étant placé dans *start. Si le producteur a fait
+ * le tour de l'anneau depuis la dernière lecture, le curseur est d'abord
+ * recalé sur le plus ancien échantillon encore présent et la perte est
+ * comptabilisée.
+ */
+static u32 adxl345_file_claim(struct adxl345_file *ctx, u32 max, u32 *start)
+{
+    struct adxl345_device *dev = ctx->dev;
+    u32 *cursor = adxl345_file_cursor(ctx);
+    u32 head, tail, avail, n;
+
+    for (;;) {
+        head = smp_load_acquire(&dev->head);
+        tail = READ_ONCE(*cursor);
+        avail = head - tail;
+
+        if (avail > dev->ring_size) {
+            if (cmpxchg(cursor, tail, head - dev->ring_size) == tail) {
+                adxl345_file_lost(ctx, avail - dev->ring_size);
+                atomic64_add(avail - dev->ring_size, &dev->overwritten);
+                trace_adxl345_ring_overwrite(dev->miscdev.name, ctx, avail - dev->ring_size);
+                WRITE_ONCE(ctx->gap, true);
+            }
+            continue;
+        }
+
+        n = min(avail, max);
+        if (!n || cmpxchg(cursor, tail, tail + n) == tail)
+            break;
+        // Un autre thread a lu sur ce fichier entre-temps : recommencer
+    }
+
+    *start = tail;
+    return n;
+}
+
+/*
+ * Lecteur du flux d'échantillons. Un fichier en format événements ou
+ * captures reste dans dev->readers mais n'avance plus son curseur : il ne
+ * doit peser ni sur la place libre ni sur le watermark adaptatif.
+ */
+static bool adxl345_file_samples(struct adxl345_file *ctx)
+{
+    int format = READ_ONCE(ctx->format);
+
+    return format != ADXL345_FORMAT_EVENTS && format != ADXL345_FORMAT_CAPTURE;
+}
+
+/*
+ * Places que drop-newest et backpressure laissent toujours libres. Un
+ * lecteur avance son curseur avant de copier ce qu'il a réservé (au plus
+ * ADXL345_READ_CHUNK échantillons) : avec cette marge, le producteur ne
+ * peut pas réécrire une entrée en cours de copie, et ces deux politiques
+ * n'écrasent jamais rien (voir adxl345_ring_fetch).
+ */
+static u32 adxl345_ring_reserve(struct adxl345_device *dev)
+{
+    return READ_ONCE(dev->overrun_policy) == ADXL345_OVERRUN_OVERWRITE ? 0 : ADXL345_READ_CHUNK;
+}
+
+// Places libres pour le lecteur le plus en retard (toutes si aucun lecteur)
+static u32 adxl345_ring_space(struct adxl345_device *dev)
+{
+    u32 reserve = adxl345_ring_reserve(dev);
+    struct adxl345_file *ctx;
+    u32 pending, backlog = 0;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(ctx, &dev->readers, list) {
+        if (!adxl345_file_samples(ctx))
+            continue;
+        pending = adxl345_file_pending(ctx);
+        backlog = max(backlog, pending);
+    }
+    rcu_read_unlock();
+
+    return backlog + reserve < dev->ring_size ? dev->ring_size - reserve - backlog : 0;
+}
+
+/*
+ * Échantillons qui n'entreront jamais dans l'anneau : tous les lecteurs les
+ * perdent, et le prochain échantillon publié porte ADXL345_SAMPLE_OVERRUN.
+ * Côté producteur uniquement.
+ */
+static void adxl345_ring_drop(struct adxl345_device *dev, u32 n)
+{
+    struct adxl345_file *ctx;
+
+    atomic64_add(n, &dev->dropped);
+    dev->gap = true;
+    trace_adxl345_ring_drop(dev->miscdev.name, READ_ONCE(dev->overrun_policy), n);
+
+    // Un lecteur d'événements ou de captures repartira de head (SET_FORMAT)
+    rcu_read_lock();
+    list_for_each_entry_rcu(ctx, &dev->readers, list) {
+        if (adxl345_file_samples(ctx))
+            adxl345_file_lost(ctx, n);
+    }
+    rcu_read_unlock();
+}
+
+/*
+ * Ajoute un lot d'échantillons à l'anneau et le publie d'un coup, y compris
+ * dans l'en-tête des lecteurs qui l'ont projeté. Seule la vidange appelle
+ * cette fonction : un unique producteur, aucun verrou. En mode drop-newest,
+ * la fin du lot qui écraserait des échantillons non lus est jetée.
+ */
+static void adxl345_ring_push(struct adxl345_device *dev,
+                              const struct adxl345_sample_ext *samples, unsigned int n)
+{
+    struct adxl345_sample_ext *slot;
+    struct adxl345_file *ctx;
+    u32 head = dev->head;
+    unsigned int i, space;
+
+    if (READ_ONCE(dev->overrun_policy) == ADXL345_OVERRUN_DROP_NEWEST) {
+        space = adxl345_ring_space(dev);
+        if (n > space) {
+            adxl345_ring_drop(dev, n - space);
+            n = space;
+        }
+    }
+
+    if (!n)
+        return;
+    WARN_ON_ONCE(n > ADXL345_RING_MAX_BATCH);
+
+    for (i = 0; i < n; i++, head++) {
+        slot = &dev->ring[head & (dev->ring_size - 1)];
+
+        // seq invalide pendant la réécriture, pour les lecteurs mmap()
+        WRITE_ONCE(slot->seq, head - 1);
+        smp_wmb();
+        slot->timestamp = samples[i].timestamp;
+        slot->x = samples[i].x;
+        slot->y = samples[i].y;
+        slot->z = samples[i].z;
+        slot->flags = 0;
+        if (dev->gap) {
+            slot->flags |= ADXL345_SAMPLE_OVERRUN;
+            dev->gap = false;
+        }
+        smp_wmb();
+        WRITE_ONCE(slot->seq, head);
+    }
+
+    // Les échantillons doivent être visibles avant le nouvel index
+    smp_store_release(&dev->head, head);
+    trace_adxl345_ring_push(dev->miscdev.name, head, n);
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(ctx, &dev->readers, list) {
+        if (ctx->mmap_hdr)
+            smp_store_release(&ctx->mmap_hdr->head, head);
+    }
+    rcu_read_unlock();
+
+    // Le lot suivant ne doit pas être visible avant ce head
+    smp_wmb();
+}
+
+// Profondeur par défaut, remplacée par la propriété DT ring-entries
+static unsigned int ring_entries = ADXL345_RING_ENTRIES;
+module_param(ring_entries, uint, 0444);
+MODULE_PARM_DESC(ring_entries, "Default software ring depth in samples, rounded up to a power of two (default 1024)");
+
+static int adxl345_ring_alloc(struct adxl345_device *dev, u32 entries)
+{
+    dev->ring_size = entries;
+    dev->ring_bytes = PAGE_ALIGN(entries * sizeof(struct adxl345_sample_ext));
+    dev->ring = vmalloc_user(dev->ring_bytes); // Mémoire mise à zéro
+    if (!dev->ring)
+        return -ENOMEM;
+
+    return 0;
+}
+
+// Nombre d'entrées effectif, ou 0 si la profondeur demandée est hors bornes
+static u32 adxl345_ring_entries(u32 entries)
+{
+    if (entries < ADXL345_RING_MIN_ENTRIES || entries > ADXL345_RING_MAX_ENTRIES)
+        return 0;
+
+    return roundup_pow_of_two(entries);
+}
+
+/*
+ * Changement de profondeur à chaud. Les échantillons encore dans l'anneau
+ * sont recopiés (les plus récents, dans la limite de la nouvelle taille) et
+ * les curseurs des lecteurs restent valides : un lecteur en retard de plus
+ * que la nouvelle taille est simplement compté en perte. Refusé tant qu'un
+ * fichier a projeté l'anneau, dont la taille est figée dans son en-tête.
+ */
+static int adxl345_ring_resize(struct adxl345_device *dev, u32 entries)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    struct adxl345_sample_ext *ring, *old;
+    struct adxl345_file *ctx;
+    size_t bytes;
+    u32 head, keep, i;
+    int ret = 0;
+
+    entries = adxl345_ring_entries(entries);
+    if (!entries)
+        return -EINVAL;
+
+    bytes = PAGE_ALIGN(entries * sizeof(struct adxl345_sample_ext));
+    ring = vmalloc_user(bytes);
+    if (!ring)
+        return -ENOMEM;
+
+    // Ordre : ring_sem, readers_lock, config_lock
+    down_write(&dev->ring_sem);
+    mutex_lock(&dev->readers_lock);
+    list_for_each_entry(ctx, &dev->readers, list) {
+        if (ctx->mmap_hdr) {
+            ret = -EBUSY;
+            goto out;
+        }
+    }
+
+    // Arrêter le producteur : ni interruption, ni reconfiguration en cours
+    mutex_lock(&dev->config_lock);
+    disable_irq(client->irq);
+
+    head = dev->head;
+    keep = min(dev->ring_size, entries);
+    for (i = head - keep; i != head; i++)
+        ring[i & (entries - 1)] = dev->ring[i & (dev->ring_size - 1)];
+
+    old = dev->ring;
+    dev->ring = ring;
+    dev->ring_bytes = bytes;
+    WRITE_ONCE(dev->ring_size, entries);
+    ring = old;
+
+    enable_irq(client->irq);
+    mutex_unlock(&dev->config_lock);
+out:
+    mutex_unlock(&dev->readers_lock);
+    up_write(&dev->ring_sem);
+
+    // L'ancien anneau, ou le nouveau si le redimensionnement est refusé
+    vfree(ring);
+    return ret;
+}
+
+static size_t adxl345_record_size(int format, int axes)
+{
+    switch (format) {
+    case ADXL345_FORMAT_EXT:
+        return sizeof(struct adxl345_sample_ext);
+    case ADXL345_FORMAT_PACKED:
+        return hweight8(axes) * sizeof(s16);
+    case ADXL345_FORMAT_EVENTS:
+        return sizeof(struct adxl345_event);
+    case ADXL345_FORMAT_CAPTURE:
+        return sizeof(struct adxl345_capture);
+    default:
+        return sizeof(struct adxl345_sample);
+    }
+}
+
+/*
+ * Réserve au plus n échantillons (n <= ADXL345_READ_CHUNK) et les copie dans
+ * recs. En mode overwrite, on relit head après la copie pour écarter ceux
+ * que le producteur a pu réécrire entre-temps (au plus
+ * ADXL345_RING_MAX_BATCH entrées au-delà de head - ring_size) : les
+ * enregistrements valides commencent à recs[*skip]. Les autres politiques
+ * gardent une réserve (adxl345_ring_reserve) et ne réécrivent jamais une
+ * entrée non lue : rien à écarter, ni à compter comme écrasé.
+ * Retourne le nombre d'échantillons réservés. Appelée sous ring_sem.
+ */
+static u32 adxl345_ring_fetch(struct adxl345_file *ctx, struct adxl345_sample_ext *recs,
+                              u32 n, u32 *skip)
+{
+    struct adxl345_device *dev = ctx->dev;
+    u32 start, got, valid_from, i;
+
+    *skip = 0;
+    got = adxl345_file_claim(ctx, n, &start);
+    if (!got)
+        return 0;
+
+    for (i = 0; i < got; i++)
+        recs[i] = dev->ring[(start + i) & (dev->ring_size - 1)];
+    smp_rmb();
+
+    valid_from = READ_ONCE(dev->head) - dev->ring_size + ADXL345_RING_MAX_BATCH;
+    if (READ_ONCE(dev->overrun_policy) == ADXL345_OVERRUN_OVERWRITE &&
+        (s32)(valid_from - start) > 0) {
+        *skip = min(valid_from - start, got);
+        adxl345_file_lost(ctx, *skip);
+        atomic64_add(*skip, &dev->overwritten);
+        trace_adxl345_ring_overwrite(dev->miscdev.name, ctx, *skip);
+        WRITE_ONCE(ctx->gap, true);
+    }
+
+    // Signaler dans le flux la perte propre à ce lecteur
+    if (*skip < got && READ_ONCE(ctx->gap)) {
+        WRITE_ONCE(ctx->gap, false);
+        recs[*skip].flags |= ADXL345_SAMPLE_OVERRUN;
+    }
+
+    return got;
+}
+
+/*
+ * Copie au plus n échantillons de l'anneau vers to, au format du lecteur.
+ * Les enregistrements transitent par un tampon sur la pile et peuvent
+ * chevaucher deux segments d'une lecture vectorisée.
+ * Retourne le nombre d'octets copiés.
+ */
+static ssize_t adxl345_ring_read(struct adxl345_file *ctx, struct iov_iter *to, u32 n,
+                                 int format, int axes)
+{
+    size_t rec_size = adxl345_record_size(format, axes);
+    struct adxl345_sample_ext recs[ADXL345_READ_CHUNK];
+    s16 packed[ADXL345_READ_CHUNK * 3];
+    u32 got, skip, i, j;
+    size_t copied = 0, bytes;
+    const void *out;
+
+    // RAW ignore la sélection d'axes, même laissée par SET_AXIS ou SET_AXES
+    if (format != ADXL345_FORMAT_PACKED)
+        axes = ADXL345_AXIS_ALL;
+
+    while (n) {
+        got = adxl345_ring_fetch(ctx, recs, min_t(u32, n, ADXL345_READ_CHUNK), &skip);
+        if (!got)
+            break;
+
+        if (format == ADXL345_FORMAT_EXT) {
+            out = &recs[skip];
+            bytes = (got - skip) * rec_size;
+        } else {
+            // RAW : les trois axes ; PACKED : seulement ceux retenus
+            for (i = skip, j = 0; i < got; i++) {
+                if (axes & ADXL345_AXIS_X)
+                    packed[j++] = recs[i].x;
+                if (axes & ADXL345_AXIS_Y)
+                    packed[j++] = recs[i].y;
+                if (axes & ADXL345_AXIS_Z)
+                    packed[j++] = recs[i].z;
+            }
+            out = packed;
+            // Ce qui a été écrit dans packed, pas plus
+            bytes = j * sizeof(s16);
+        }
+
+        if (copy_to_iter(out, bytes, to) != bytes)
+            return copied ? copied : -EFAULT;
+
+        copied += bytes;
+        n -= got;
+    }
+
+    return copied;
+}
+
+// Dernière référence rendue : retrait fait et dernier fichier fermé
+static void adxl345_dev_free(struct kref *ref)
+{
+    struct adxl345_device *dev = container_of(ref, struct adxl345_device, ref);
+
+    kfree(dev->miscdev.name);
+    vfree(dev->ring);
+    kfree(dev);
+}
+
+/*
+ * Entrée dans une opération sur un fichier : -ENODEV une fois le capteur
+ * retiré. Sans attente avec nowait, le retrait en cours étant la seule
+ * cause de blocage.
+ */
+static int adxl345_file_enter(struct adxl345_file *ctx, bool nowait)
+{
+    struct adxl345_device *dev = ctx->dev;
+
+    if (nowait) {
+        if (!down_read_trylock(&dev->remove_sem))
+            return -EAGAIN;
+    } else {
+        down_read(&dev->remove_sem);
+    }
+    if (READ_ONCE(dev->dead)) {
+        up_read(&dev->remove_sem);
+        return -ENODEV;
+    }
+    return 0;
+}
+
+static void adxl345_file_leave(struct adxl345_file *ctx)
+{
+    up_read(&ctx->dev->remove_sem);
+}
+
+/*
+ * Nouveau lecteur de l'anneau de dev, pour /dev/adxl345-N comme pour
+ * /dev/adxl345-all (un par capteur).
+ */
+static struct adxl345_file *adxl345_file_attach(struct adxl345_device *dev)
+{
+    struct adxl345_file *ctx;
+    int ret;
+
+    // Sortir le capteur de veille : il mesure tant qu'un fichier est ouvert
+    ret = pm_runtime_resume_and_get(dev->miscdev.parent);
+    if (ret)
+        return ERR_PTR(ret);
+
+    ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+    if (!ctx) {
+        pm_runtime_put_autosuspend(dev->miscdev.parent);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    // Appelée sous misc_mtx ou adxl345_devices_lock : le retrait n'a pas commencé
+    kref_get(&dev->ref);
+    ctx->dev = dev;
+    ctx->axes = ADXL345_AXIS_ALL;
+    atomic64_set(&ctx->overruns, 0);
+    init_waitqueue_head(&ctx->poll_wait);
+
+    // Un nouveau lecteur ne voit que les échantillons arrivés après open()
+    mutex_lock(&dev->readers_lock);
+    ctx->tail = smp_load_acquire(&dev->head);
+    ctx->event_tail = READ_ONCE(dev->event_head);
+    ctx->capture_tail = READ_ONCE(dev->capture_head);
+    list_add_tail_rcu(&ctx->list, &dev->readers);
+    mutex_unlock(&dev->readers_lock);
+
+    return ctx;
+}
+
+static void adxl345_file_detach(struct adxl345_file *ctx)
+{
+    struct adxl345_device *dev = ctx->dev;
+
+    mutex_lock(&dev->readers_lock);
+    list_del_rcu(&ctx->list);
+    mutex_unlock(&dev->readers_lock);
+
+    // Attendre que la vidange ne puisse plus voir ce lecteur
+    synchronize_rcu();
+
+    // Appelée après le dernier munmap() : l'en-tête n'est plus projeté
+    vfree(ctx->mmap_hdr);
+    kfree(ctx);
+
+    // Capteur retiré : ni FIFO à reprendre ni runtime PM à relâcher
+    down_read(&dev->remove_sem);
+    if (!dev->dead) {
+        // Ce lecteur retenait peut-être la FIFO matérielle
+        adxl345_resume_stream(dev, false);
+        pm_runtime_mark_last_busy(dev->miscdev.parent);
+        pm_runtime_put_autosuspend(dev->miscdev.parent);
+    }
+    up_read(&dev->remove_sem);
+
+    kref_put(&dev->ref, adxl345_dev_free);
+}
+
+static int adxl345_open(struct inode *inode, struct file *file)
+{
+    struct adxl345_device *dev = container_of(file->private_data, struct adxl345_device, miscdev);
+    struct adxl345_file *ctx;
+
+    ctx = adxl345_file_attach(dev);
+    if (IS_ERR(ctx))
+        return PTR_ERR(ctx);
+
+    // read_iter() respecte IOCB_NOWAIT : io_uring peut lire sans passer par un thread
+    file->f_mode |= FMODE_NOWAIT;
+    file->private_data = ctx;
+    return 0;
+}
+
+/*
+ * Seuil de réveil des lecteurs : read() dort jusqu'à ce que l'anneau
+ * contienne au moins ce nombre d'échantillons non lus (ou autant que le
+ * tampon utilisateur peut en contenir, si c'est moins), puis retourne en
+ * une fois tous les échantillons entiers qui tiennent dans le tampon.
+ * Chaque fichier peut le remplacer par ADXL345_SET_LOWAT, assorti d'un
+ * délai : les échantillons en attente sont alors remis quand le plus
+ * ancien a dépassé ce délai, même en deçà du seuil. poll() et
+ * ADXL345_MMAP_WAIT appliquent la même règle.
+ */
+static unsigned int read_min_samples = 1;
+module_param(read_min_samples, uint, 0644);
+MODULE_PARM_DESC(read_min_samples, "Minimum number of queued samples before read() wakes up (default 1)");
+
+/*
+ * Seuil de réveil de ce lecteur, borné à max_n. Borné aussi sous le seuil
+ * de pause du backpressure : la FIFO se suspend dès qu'il reste moins de
+ * ADXL345_RING_MAX_BATCH places hors réserve, et un lecteur qui attendrait
+ * davantage n'arriverait jamais à faire de la place.
+ */
+static u32 adxl345_file_wanted(struct adxl345_file *ctx, u32 max_n)
+{
+    u32 lowat = READ_ONCE(ctx->lowat);
+
+    if (!lowat)
+        lowat = READ_ONCE(read_min_samples);
+    max_n = min(max_n, READ_ONCE(ctx->dev->ring_size) - ADXL345_READ_CHUNK -
+                       ADXL345_RING_MAX_BATCH);
+    return min(max_n, max(lowat, 1U));
+}
+
+/*
+ * Instant de mesure estimé du plus ancien échantillon en attente, sans
+ * toucher à l'anneau : les échantillons publiés sont régulièrement espacés
+ * (période, multipliée par la décimation du filtre) jusqu'au dernier vidé.
+ */
+static s64 adxl345_file_oldest(struct adxl345_file *ctx, u32 pending)
+{
+    struct adxl345_device *dev = ctx->dev;
+    u64 spacing = READ_ONCE(dev->odr_period_ns) * max(READ_ONCE(dev->filter.decimation), 1U);
+
+    return READ_ONCE(dev->last_timestamp) - (s64)(pending - 1) * spacing;
+}
+
+static bool adxl345_file_ready(struct adxl345_file *ctx, u32 wanted)
+{
+    u32 pending = adxl345_file_pending(ctx);
+    u64 timeout = READ_ONCE(ctx->lowat_timeout_ns);
+
+    if (pending >= wanted)
+        return true;
+    if (!pending || !timeout)
+        return false;
+    return ktime_get_ns() - adxl345_file_oldest(ctx, pending) >= timeout;
+}
+
+static u32 adxl345_event_pending(struct adxl345_file *ctx)
+{
+    return READ_ONCE(ctx->dev->event_head) - READ_ONCE(ctx->event_tail);
+}
+
+static u32 adxl345_capture_pending(struct adxl345_file *ctx)
+{
+    return READ_ONCE(ctx->dev->capture_head) - READ_ONCE(ctx->capture_tail);
+}
+
+/*
+ * Attente filtrée côté producteur : chaque thread endormi sur wait_queue y
+ * inscrit sa condition, que adxl345_waiter_wake() évalue au réveil. Une
+ * vidange ne réveille ainsi que les lecteurs qu'elle rend prêts, au lieu de
+ * faire réévaluer leur seuil à tous.
+ */
+struct adxl345_waiter
+{
+    struct wait_queue_entry wq;
+    struct adxl345_file *ctx;
+    int format;                 // ADXL345_FORMAT_EVENTS, _CAPTURE, sinon échantillons
+    u32 wanted;                 // Seuil de réveil, échantillons seulement
+};
+
+static bool adxl345_waiter_ready(struct adxl345_waiter *w)
+{
+    // Capteur retiré : plus rien à attendre
+    if (READ_ONCE(w->ctx->dev->dead))
+        return true;
+
+    switch (w->format) {
+    case ADXL345_FORMAT_EVENTS:
+        return adxl345_event_pending(w->ctx);
+    case ADXL345_FORMAT_CAPTURE:
+        return adxl345_capture_pending(w->ctx);
+    default:
+        return adxl345_file_ready(w->ctx, w->wanted);
+    }
+}
+
+static int adxl345_waiter_wake(struct wait_queue_entry *wq, unsigned int mode, int sync, void *key)
+{
+    struct adxl345_waiter *w = container_of(wq, struct adxl345_waiter, wq);
+
+    if (!adxl345_waiter_ready(w))
+        return 0;
+    return autoremove_wake_function(wq, mode, sync, key);
+}
+
+// Un sommeil d'au plus timeout jiffies ; l'appelant réévalue sa condition
+static int adxl345_waiter_sleep(struct adxl345_waiter *w, long timeout)
+{
+    struct adxl345_device *dev = w->ctx->dev;
+
+    init_wait(&w->wq);
+    w->wq.func = adxl345_waiter_wake;
+    prepare_to_wait(&dev->wait_queue, &w->wq, TASK_INTERRUPTIBLE);
+    if (!adxl345_waiter_ready(w) && !signal_pending(current))
+        schedule_timeout(timeout);
+    finish_wait(&dev->wait_queue, &w->wq);
+
+    return signal_pending(current) ? -ERESTARTSYS : 0;
+}
+
+/*
+ * Attend que le lecteur soit prêt. Une vidange ne réveille que s'il l'est ;
+ * le délai, lui, peut expirer entre deux vidanges (flux suspendu,
+ * fréquence basse), d'où le sommeil borné.
+ */
+static int adxl345_file_wait(struct adxl345_file *ctx, u32 wanted)
+{
+    struct adxl345_waiter w = { .ctx = ctx, .format = ADXL345_FORMAT_RAW, .wanted = wanted };
+    u64 timeout, age;
+    u32 pending;
+    long left;
+
+    while (!adxl345_file_ready(ctx, wanted)) {
+        left = MAX_SCHEDULE_TIMEOUT;
+        pending = adxl345_file_pending(ctx);
+        timeout = READ_ONCE(ctx->lowat_timeout_ns);
+        if (pending && timeout) {
+            age = ktime_get_ns() - adxl345_file_oldest(ctx, pending);
+            left = age < timeout ? nsecs_to_jiffies(timeout - age) + 1 : 1;
+        }
+        if (READ_ONCE(ctx->dev->dead))
+            return -ENODEV;
+        if (adxl345_waiter_sleep(&w, left))
+            return -ERESTARTSYS;
+    }
+
+    return 0;
+}
+
+// Attend un événement ou une capture (format ADXL345_FORMAT_EVENTS ou _CAPTURE)
+static int adxl345_queue_wait(struct adxl345_file *ctx, int format)
+{
+    struct adxl345_waiter w = { .ctx = ctx, .format = format };
+
+    while (!adxl345_waiter_ready(&w))
+        if (adxl345_waiter_sleep(&w, MAX_SCHEDULE_TIMEOUT))
+            return -ERESTARTSYS;
+
+    return READ_ONCE(ctx->dev->dead) ? -ENODEV : 0;
+}
+
+// Ce que poll() signalerait pour ce fichier : de quoi lire, ou une perte
+static bool adxl345_file_pollable(struct adxl345_file *ctx)
+{
+    struct adxl345_waiter w = {
+        .ctx = ctx,
+        .format = READ_ONCE(ctx->format),
+        .wanted = adxl345_file_wanted(ctx, READ_ONCE(ctx->dev->ring_size)),
+    };
+
+    return adxl345_waiter_ready(&w) || READ_ONCE(ctx->overrun) ||
+           READ_ONCE(ctx->queue_overrun);
+}
+
+/*
+ * Réveille les lecteurs du capteur, en datant le réveil pour
+ * wakeup_latency. Les entrées de poll() ne portent pas de condition :
+ * chaque fichier a sa propre file, réveillée seulement s'il est prêt.
+ */
+static void adxl345_wake(struct adxl345_device *dev)
+{
+    struct adxl345_file *ctx;
+
+    WRITE_ONCE(dev->wake_ns, ktime_get_ns());
+    wake_up(&dev->wait_queue);
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(ctx, &dev->readers, list) {
+        if (wq_has_sleeper(&ctx->poll_wait) && adxl345_file_pollable(ctx))
+            wake_up(&ctx->poll_wait);
+    }
+    rcu_read_unlock();
+}
+
+/*
+ * Dernier échantillon vidé, sans rien consommer des files des lecteurs.
+ * S'il date de plus d'une période, un plus récent attend dans la FIFO :
+ * elle est vidée aussitôt, ses entrées rejoignent l'anneau comme à la
+ * prochaine interruption. Lire DATAX0..DATAZ1 directement dépilerait une
+ * entrée de la FIFO, jamais en mode bypass ici, qui manquerait au flux.
+ */
+static int adxl345_get_latest(struct adxl345_device *dev, struct adxl345_sample_ext *rec)
+{
+    unsigned int start;
+    bool stale = false;
+
+    if (READ_ONCE(dev->last_timestamp) + (s64)READ_ONCE(dev->odr_period_ns) < ktime_get_ns())
+        stale = !adxl345_latest_refresh(dev);
+
+    do {
+        start = read_seqcount_begin(&dev->latest_seq);
+        *rec = dev->latest;
+    } while (read_seqcount_retry(&dev->latest_seq, start));
+
+    // Aucune vidange depuis la mise sous tension
+    if (!rec->timestamp)
+        return -ENODATA;
+    if (stale)
+        rec->flags |= ADXL345_SAMPLE_STALE;
+    return 0;
+}
+
+/*
+ * État des files de ce lecteur. Avec hw, FIFO_STATUS est lu sur le bus :
+ * sa lecture ne dépile rien, le flux n'est pas perturbé (FIONREAD s'en
+ * passe). Les compteurs en attente sont bornés à la profondeur de chaque
+ * file, comme ce que read() peut effectivement retourner.
+ */
+static int adxl345_queue_state(struct adxl345_file *ctx, struct adxl345_queue_state *st, bool hw)
+{
+    struct adxl345_device *dev = ctx->dev;
+    unsigned int status = 0;
+    int ret;
+
+    memset(st, 0, sizeof(*st));
+    if (hw) {
+        ret = regmap_read(dev->regmap, ADXL345_REG_FIFO_STATUS, &status);
+        if (ret)
+            return ret;
+    }
+
+    st->pending = min(adxl345_file_pending(ctx), READ_ONCE(dev->ring_size));
+    st->events_pending = min_t(u32, adxl345_event_pending(ctx), ADXL345_EVENT_RING);
+    st->captures_pending = min_t(u32, adxl345_capture_pending(ctx), ADXL345_CAPTURE_RING);
+    switch (READ_ONCE(ctx->format)) {
+    case ADXL345_FORMAT_EVENTS:
+        st->bytes = st->events_pending * sizeof(struct adxl345_event);
+        if (READ_ONCE(ctx->queue_overrun) || adxl345_event_pending(ctx) > ADXL345_EVENT_RING)
+            st->flags |= ADXL345_QUEUE_OVERRUN;
+        break;
+    case ADXL345_FORMAT_CAPTURE:
+        st->bytes = st->captures_pending * sizeof(struct adxl345_capture);
+        if (READ_ONCE(ctx->queue_overrun) || adxl345_capture_pending(ctx) > ADXL345_CAPTURE_RING)
+            st->flags |= ADXL345_QUEUE_OVERRUN;
+        break;
+    default:
+        st->bytes = st->pending * adxl345_record_size(READ_ONCE(ctx->format),
+                                                      READ_ONCE(ctx->axes));
+        if (READ_ONCE(ctx->overrun) || adxl345_file_pending(ctx) > READ_ONCE(dev->ring_size))
+            st->flags |= ADXL345_QUEUE_OVERRUN;
+        break;
+    }
+
+    st->hw_entries = status & ADXL345_FIFO_ENTRIES_MASK;
+    if (READ_ONCE(dev->paused))
+        st->flags |= ADXL345_QUEUE_PAUSED;
+    if (READ_ONCE(dev->polling))
+        st->flags |= ADXL345_QUEUE_POLLING;
+    if (status & ADXL345_FIFO_TRIG)
+        st->flags |= ADXL345_QUEUE_TRIGGERED;
+    st->lost = atomic64_read(&ctx->overruns);
+    adxl345_get_config(dev, &st->config);
+
+    return 0;
+}
+
+static long adxl345_file_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    struct adxl345_file *ctx = file->private_data;
+    struct adxl345_device *dev = ctx->dev;
+    struct adxl345_config cfg;
+    u32 start;
+    int ret;
+
+    pr_debug("ADXL345_IOCTL received cmd: 0x%x, arg: %lu\n", cmd, arg);
+
+    switch (cmd) {
+    case ADXL345_SET_AXIS:
+        if (arg > 2) {
+            pr_err("Invalid axis: %lu\n", arg);
+            return -EINVAL;
+        }
+        // Un seul axe : read() retourne un int16 par échantillon
+        WRITE_ONCE(ctx->axes, 1 << arg);
+        WRITE_ONCE(ctx->format, ADXL345_FORMAT_PACKED);
+        pr_debug("ADXL345 axis set to %lu\n", arg);
+        break;
+
+    case ADXL345_SET_AXES:
+        if (!arg || arg > ADXL345_AXIS_ALL)
+            return -EINVAL;
+        WRITE_ONCE(ctx->axes, arg);
+        WRITE_ONCE(ctx->format, ADXL345_FORMAT_PACKED);
+        break;
+
+    case ADXL345_MMAP_WAIT:
+        // Bloquer jusqu'à ce que l'anneau contienne assez d'échantillons pour ce lecteur
+        ret = adxl345_file_wait(ctx, adxl345_file_wanted(ctx, READ_ONCE(dev->ring_size)));
+        if (ret)
+            return ret;
+
+        // Recaler tail et comptabiliser dans l'en-tête les échantillons écrasés
+        down_read(&dev->ring_sem);
+        adxl345_file_claim(ctx, 0, &start);
+        up_read(&dev->ring_sem);
+        adxl345_file_mark_read(ctx);
+        adxl345_resume_stream(dev, false);
+        break;
+
+    case ADXL345_SET_FORMAT:
+        if (arg != ADXL345_FORMAT_RAW && arg != ADXL345_FORMAT_EXT &&
+            arg != ADXL345_FORMAT_PACKED && arg != ADXL345_FORMAT_EVENTS &&
+            arg != ADXL345_FORMAT_CAPTURE)
+            return -EINVAL;
+        // De retour au flux : seuls les échantillons arrivés après comptent
+        if (!adxl345_file_samples(ctx) && arg != ADXL345_FORMAT_EVENTS &&
+            arg != ADXL345_FORMAT_CAPTURE)
+            WRITE_ONCE(*adxl345_file_cursor(ctx), smp_load_acquire(&dev->head));
+        WRITE_ONCE(ctx->format, arg);
+        // Ce fichier ne retient plus la FIFO suspendue
+        adxl345_resume_stream(dev, false);
+        break;
+
+    case ADXL345_SET_RATE:
+        // Les setters prennent un u32 : 0x100000064 ne doit pas valoir 100
+        if (arg > U32_MAX)
+            return -EINVAL;
+        return adxl345_set_rate(dev, arg);
+
+    case ADXL345_SET_RANGE:
+        if (arg > U32_MAX)
+            return -EINVAL;
+        adxl345_get_config(dev, &cfg);
+        return adxl345_set_format(dev, arg, cfg.full_res);
+
+    case ADXL345_SET_FULL_RES:
+        adxl345_get_config(dev, &cfg);
+        return adxl345_set_format(dev, cfg.range_g, arg != 0);
+
+    case ADXL345_SET_WATERMARK:
+        if (arg > U32_MAX)
+            return -EINVAL;
+        return adxl345_set_watermark(dev, arg);
+
+    case ADXL345_GET_CONFIG:
+        adxl345_get_config(dev, &cfg);
+        if (copy_to_user((void __user *)arg, &cfg, sizeof(cfg)))
+            return -EFAULT;
+        break;
+
+    case ADXL345_SET_RING_SIZE:
+        if (arg > U32_MAX)
+            return -EINVAL;
+        return adxl345_ring_resize(dev, arg);
+
+    case ADXL345_SET_FILTER: {
+        struct adxl345_filter filter;
+
+        if (copy_from_user(&filter, (void __user *)arg, sizeof(filter)))
+            return -EFAULT;
+        return adxl345_set_filter(dev, &filter);
+    }
+
+    case ADXL345_GET_FILTER:
+        mutex_lock(&dev->config_lock);
+        ret = copy_to_user((void __user *)arg, &dev->filter, sizeof(dev->filter));
+        mutex_unlock(&dev->config_lock);
+        if (ret)
+            return -EFAULT;
+        break;
+
+    case ADXL345_SET_EVENTS: {
+        struct adxl345_events_config events;
+
+        if (copy_from_user(&events, (void __user *)arg, sizeof(events)))
+            return -EFAULT;
+        return adxl345_set_events(dev, &events);
+    }
+
+    case ADXL345_GET_EVENTS:
+        mutex_lock(&dev->config_lock);
+        ret = copy_to_user((void __user *)arg, &dev->events, sizeof(dev->events));
+        mutex_unlock(&dev->config_lock);
+        if (ret)
+            return -EFAULT;
+        break;
+
+    case ADXL345_SET_CAPTURE: {
+        struct adxl345_capture_config capture;
+
+        if (copy_from_user(&capture, (void __user *)arg, sizeof(capture)))
+            return -EFAULT;
+        return adxl345_set_capture(dev, &capture);
+    }
+
+    case ADXL345_GET_CAPTURE:
+        mutex_lock(&dev->config_lock);
+        ret = copy_to_user((void __user *)arg, &dev->capture, sizeof(dev->capture));
+        mutex_unlock(&dev->config_lock);
+        if (ret)
+            return -EFAULT;
+        break;
+
+    case ADXL345_SET_LOWAT: {
+        struct adxl345_lowat lowat;
+
+        if (copy_from_user(&lowat, (void __user *)arg, sizeof(lowat)))
+            return -EFAULT;
+        if (lowat.samples > ADXL345_RING_MAX_ENTRIES)
+            return -EINVAL;
+        WRITE_ONCE(ctx->lowat, lowat.samples);
+        WRITE_ONCE(ctx->lowat_timeout_ns, (u64)lowat.timeout_ms * NSEC_PER_MSEC);
+        // Un lecteur déjà endormi réévalue son délai
+        adxl345_wake(dev);
+        break;
+    }
+
+    case FIONREAD: {
+        struct adxl345_queue_state st;
+
+        adxl345_queue_state(ctx, &st, false);
+        return put_user(st.bytes, (int __user *)arg);
+    }
+
+    case ADXL345_GET_QUEUE_STATE: {
+        struct adxl345_queue_state st;
+
+        ret = adxl345_queue_state(ctx, &st, true);
+        if (ret)
+            return ret;
+        if (copy_to_user((void __user *)arg, &st, sizeof(st)))
+            return -EFAULT;
+        break;
+    }
+
+    case ADXL345_GET_LATEST: {
+        struct adxl345_sample_ext rec;
+
+        ret = adxl345_get_latest(dev, &rec);
+        if (ret)
+            return ret;
+        if (copy_to_user((void __user *)arg, &rec, sizeof(rec)))
+            return -EFAULT;
+        break;
+    }
+
+    case ADXL345_GET_OVERRUNS: {
+        struct adxl345_overruns ovr = {
+            .dropped = atomic64_read(&dev->dropped),
+            .overwritten = atomic64_read(&dev->overwritten),
+            .lost = atomic64_read(&ctx->overruns),
+        };
+
+        if (copy_to_user((void __user *)arg, &ovr, sizeof(ovr)))
+            return -EFAULT;
+        break;
+    }
+
+    default:
+        pr_err("Unknown command: 0x%x\n", cmd);
+        return -ENOTTY; // Commande non supportée
+    }
+
+    return 0;
+}
+
+/*
+ * read() en ADXL345_FORMAT_EVENTS : événements arrivés depuis la dernière
+ * lecture, sans seuil de réveil. Un lecteur en retard de plus de
+ * ADXL345_EVENT_RING événements perd les plus anciens (EPOLLERR).
+ */
+static ssize_t adxl345_read_events(struct file *file, struct iov_iter *to, bool nowait)
+{
+    struct adxl345_file *ctx = file->private_data;
+    struct adxl345_device *dev = ctx->dev;
+    struct adxl345_event events[ADXL345_READ_CHUNK];
+    size_t count = iov_iter_count(to);
+    u32 head, n, i;
+    int ret;
+
+    if (count < sizeof(struct adxl345_event))
+        return -EINVAL;
+
+    do {
+        if (nowait) {
+            if (!adxl345_event_pending(ctx))
+                return -EAGAIN;
+        } else {
+            ret = adxl345_queue_wait(ctx, ADXL345_FORMAT_EVENTS);
+            if (ret)
+                return ret;
+        }
+
+        spin_lock(&dev->event_lock);
+        head = dev->event_head;
+        if (head - ctx->event_tail > ADXL345_EVENT_RING) {
+            ctx->event_tail = head - ADXL345_EVENT_RING;
+            WRITE_ONCE(ctx->queue_overrun, true);
+        }
+        n = min3(head - ctx->event_tail, (u32)(count / sizeof(events[0])), (u32)ADXL345_READ_CHUNK);
+        for (i = 0; i < n; i++)
+            events[i] = dev->event_ring[(ctx->event_tail + i) & (ADXL345_EVENT_RING - 1)];
+        WRITE_ONCE(ctx->event_tail, ctx->event_tail + n);
+        spin_unlock(&dev->event_lock);
+    } while (!n); // Un autre thread a tout lu
+
+    if (copy_to_iter(events, n * sizeof(events[0]), to) != n * sizeof(events[0]))
+        return -EFAULT;
+    WRITE_ONCE(ctx->queue_overrun, false);
+    return n * sizeof(events[0]);
+}
+
+/*
+ * read() en ADXL345_FORMAT_CAPTURE : captures entières, autant que le
+ * tampon peut en contenir. Elles sont trop grosses pour un lot sur la
+ * pile : une à la fois, hors du verrou pour copy_to_user().
+ */
+static ssize_t adxl345_read_captures(struct file *file, struct iov_iter *to, bool nowait)
+{
+    struct adxl345_file *ctx = file->private_data;
+    struct adxl345_device *dev = ctx->dev;
+    struct adxl345_capture rec;
+    size_t count = iov_iter_count(to), copied = 0;
+    u32 head;
+    bool got;
+    int ret;
+
+    if (count < sizeof(rec))
+        return -EINVAL;
+
+    while (count - copied >= sizeof(rec)) {
+        if (copied || nowait) {
+            if (!adxl345_capture_pending(ctx))
+                break;
+        } else {
+            ret = adxl345_queue_wait(ctx, ADXL345_FORMAT_CAPTURE);
+            if (ret)
+                return ret;
+        }
+
+        spin_lock(&dev->capture_lock);
+        head = dev->capture_head;
+        if (head - ctx->capture_tail > ADXL345_CAPTURE_RING) {
+            ctx->capture_tail = head - ADXL345_CAPTURE_RING;
+            WRITE_ONCE(ctx->queue_overrun, true);
+        }
+        got = head != ctx->capture_tail;
+        if (got) {
+            rec = dev->capture_ring[ctx->capture_tail & (ADXL345_CAPTURE_RING - 1)];
+            WRITE_ONCE(ctx->capture_tail, ctx->capture_tail + 1);
+        }
+        spin_unlock(&dev->capture_lock);
+        if (!got)
+            continue; // Un autre thread l'a lue
+
+        if (copy_to_iter(&rec, sizeof(rec), to) != sizeof(rec))
+            return copied ? copied : -EFAULT;
+        copied += sizeof(rec);
+    }
+
+    if (copied)
+        WRITE_ONCE(ctx->queue_overrun, false);
+    return copied ? copied : -EAGAIN;
+}
+
+/*
+ * Lecture sans attente : O_NONBLOCK, ou IOCB_NOWAIT (io_uring, preadv2 avec
+ * RWF_NOWAIT). Dans ce second cas, aucun verrou susceptible de dormir n'est
+ * attendu non plus : -EAGAIN, et io_uring refait la lecture en bloquant.
+ */
+static bool adxl345_nowait(struct kiocb *iocb)
+{
+    return (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+}
+
+/*
+ * Reprise du flux après une lecture. Avec IOCB_NOWAIT, la vidange qu'elle
+ * implique (config_lock, bus I2C) est confiée à resume_work.
+ */
+static void adxl345_read_done(struct adxl345_device *dev, struct kiocb *iocb)
+{
+    if (!(iocb->ki_flags & IOCB_NOWAIT))
+        adxl345_resume_stream(dev, false);
+    else if (READ_ONCE(dev->paused))
+        schedule_work(&dev->resume_work);
+}
+
+static ssize_t adxl345_file_read(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct file *file = iocb->ki_filp;
+    struct adxl345_file *ctx = file->private_data;
+    struct adxl345_device *dev = ctx->dev;
+    int format = READ_ONCE(ctx->format), axes = READ_ONCE(ctx->axes);
+    size_t rec_size = adxl345_record_size(format, axes);
+    size_t count = iov_iter_count(to);
+    u64 start = ktime_get_ns(), wait_ns = 0;
+    bool nowait = adxl345_nowait(iocb);
+    u32 wanted, max_n;
+    bool slept;
+    ssize_t ret;
+
+    if (format == ADXL345_FORMAT_EVENTS)
+        return adxl345_read_events(file, to, nowait);
+    if (format == ADXL345_FORMAT_CAPTURE)
+        return adxl345_read_captures(file, to, nowait);
+
+    // Le tampon doit pouvoir contenir au moins un échantillon entier
+    if (count < rec_size)
+        return -EINVAL;
+
+    max_n = min_t(size_t, count / rec_size, READ_ONCE(dev->ring_size));
+    wanted = adxl345_file_wanted(ctx, max_n);
+
+    do {
+        // En mode non bloquant, on retourne ce qui est disponible sans attendre
+        if (nowait) {
+            if (!adxl345_file_pending(ctx))
+                return -EAGAIN;
+        } else {
+            slept = !adxl345_file_ready(ctx, wanted);
+            ret = adxl345_file_wait(ctx, wanted);
+            if (ret)
+                return ret; // -ERESTARTSYS : réessayer en cas de signal
+            // Un réveil daté d'avant l'attente n'est pas celui-ci
+            if (slept && READ_ONCE(dev->wake_ns) >= start)
+                adxl345_hist_add(&dev->stats.wakeup_latency,
+                                 ktime_get_ns() - READ_ONCE(dev->wake_ns));
+        }
+        wait_ns = ktime_get_ns() - start;
+
+        // Rien de copié : un autre thread a tout lu, ou tout était écrasé
+        if (iocb->ki_flags & IOCB_NOWAIT) {
+            if (!down_read_trylock(&dev->ring_sem))
+                return -EAGAIN; // Redimensionnement en cours
+        } else {
+            down_read(&dev->ring_sem);
+        }
+        ret = adxl345_ring_read(ctx, to, max_n, format, axes);
+        up_read(&dev->ring_sem);
+    } while (!ret);
+
+    if (ret > 0) {
+        WRITE_ONCE(ctx->overrun, false);
+        atomic64_add(ret / rec_size, &dev->stats.delivered);
+        adxl345_file_mark_read(ctx);
+        adxl345_read_done(dev, iocb);
+    }
+    trace_adxl345_read(dev->miscdev.name, ctx, wait_ns, ret > 0 ? ret / rec_size : ret);
+    return ret;
+}
+
+static __poll_t adxl345_poll(struct file *file, poll_table *wait)
+{
+    struct adxl345_file *ctx = file->private_data;
+    __poll_t mask = 0;
+    u32 pending;
+
+    poll_wait(file, &ctx->poll_wait, wait);
+
+    // Capteur retiré : plus rien ne viendra
+    if (READ_ONCE(ctx->dev->dead))
+        return EPOLLHUP | EPOLLERR;
+
+    // Lecteur d'événements : réveillé par les seuls événements
+    if (READ_ONCE(ctx->format) == ADXL345_FORMAT_EVENTS) {
+        if (adxl345_event_pending(ctx))
+            mask |= EPOLLIN | EPOLLRDNORM;
+        if (READ_ONCE(ctx->queue_overrun) || adxl345_event_pending(ctx) > ADXL345_EVENT_RING)
+            mask |= EPOLLERR;
+        return mask;
+    }
+
+    // Lecteur de captures : réveillé par les seules captures complètes
+    if (READ_ONCE(ctx->format) == ADXL345_FORMAT_CAPTURE) {
+        if (adxl345_capture_pending(ctx))
+            mask |= EPOLLIN | EPOLLRDNORM;
+        if (READ_ONCE(ctx->queue_overrun) || adxl345_capture_pending(ctx) > ADXL345_CAPTURE_RING)
+            mask |= EPOLLERR;
+        return mask;
+    }
+
+    /*
+     * Un consommateur mmap() avance tail lui-même puis attend ici : c'est
+     * le seul point où le pilote voit la place libérée. Pas de config_lock
+     * ni de bus dans poll(), la reprise passe par resume_work.
+     */
+    if (READ_ONCE(ctx->dev->paused) && !adxl345_file_enter(ctx, true)) {
+        schedule_work(&ctx->dev->resume_work);
+        adxl345_file_leave(ctx);
+    }
+
+    // Même seuil de réveil que read(), tampon supposé assez grand
+    pending = adxl345_file_pending(ctx);
+    if (adxl345_file_ready(ctx, adxl345_file_wanted(ctx, READ_ONCE(ctx->dev->ring_size))))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (READ_ONCE(ctx->overrun) || pending > READ_ONCE(ctx->dev->ring_size))
+        mask |= EPOLLERR;
+
+    return mask;
+}
+
+static int adxl345_fasync(int fd, struct file *file, int on)
+{
+    struct adxl345_file *ctx = file->private_data;
+
+    return fasync_helper(fd, file, on, &ctx->dev->async_queue);
+}
+
+static int adxl345_release(struct inode *inode, struct file *file)
+{
+    // Retirer le fichier de la liste des notifications SIGIO
+    adxl345_fasync(-1, file, 0);
+
+    adxl345_file_detach(file->private_data);
+    return 0;
+}
+
+/*
+ * Projection, en deux mmap() distincts : la page d'en-tête propre au
+ * fichier à l'offset 0, en écriture (le consommateur y avance tail), puis
+ * l'anneau de diffusion commun à l'offset data_offset, en lecture seule
+ * pour qu'un lecteur ne puisse pas altérer les échantillons des autres.
+ * L'anneau se projette en entier.
+ */
+static int adxl345_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct adxl345_file *ctx = file->private_data;
+    struct adxl345_device *dev = ctx->dev;
+    struct adxl345_mmap_header *hdr;
+    unsigned long len = vma->vm_end - vma->vm_start;
+    bool ring = vma->vm_pgoff == 1;
+
+    // Sous readers_lock : la taille ne change plus une fois l'en-tête créé
+    mutex_lock(&dev->readers_lock);
+    if (ring ? len != dev->ring_bytes : vma->vm_pgoff || len != PAGE_SIZE) {
+        mutex_unlock(&dev->readers_lock);
+        return -EINVAL;
+    }
+    if (ring) {
+        if (vma->vm_flags & VM_WRITE) {
+            mutex_unlock(&dev->readers_lock);
+            return -EPERM;
+        }
+        // Pas de mprotect(PROT_WRITE) ultérieur
+        vma->vm_flags &= ~VM_MAYWRITE;
+    }
+    if (!ctx->mmap_hdr) {
+        hdr = vmalloc_user(PAGE_SIZE);
+        if (!hdr) {
+            mutex_unlock(&dev->readers_lock);
+            return -ENOMEM;
+        }
+        hdr->version = ADXL345_MMAP_VERSION;
+        hdr->record_size = sizeof(struct adxl345_sample_ext);
+        hdr->size = dev->ring_size;
+        hdr->data_offset = PAGE_SIZE;
+        hdr->head = smp_load_acquire(&dev->head);
+        hdr->tail = READ_ONCE(ctx->tail);
+        // Le curseur passe dans l'en-tête une fois celui-ci initialisé
+        smp_store_release(&ctx->mmap_hdr, hdr);
+    }
+    mutex_unlock(&dev->readers_lock);
+
+    if (ring)
+        return remap_vmalloc_range_partial(vma, vma->vm_start, dev->ring, 0, len);
+    return remap_vmalloc_range_partial(vma, vma->vm_start, ctx->mmap_hdr, 0, len);
+}
+
+/*
+ * Points d'entrée des fichiers : l'opération s'exécute sous remove_sem,
+ * après retrait elle échoue en -ENODEV. Une lecture endormie est réveillée
+ * par le retrait, qui attend qu'elle en soit sortie.
+ */
+static ssize_t adxl345_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct adxl345_file *ctx = iocb->ki_filp->private_data;
+    ssize_t ret;
+
+    ret = adxl345_file_enter(ctx, iocb->ki_flags & IOCB_NOWAIT);
+    if (ret)
+        return ret;
+    ret = adxl345_file_read(iocb, to);
+    adxl345_file_leave(ctx);
+    return ret;
+}
+
+static long adxl345_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct adxl345_file *ctx = file->private_data;
+    long ret;
+
+    ret = adxl345_file_enter(ctx, false);
+    if (ret)
+        return ret;
+    ret = adxl345_file_ioctl(file, cmd, arg);
+    adxl345_file_leave(ctx);
+    return ret;
+}
+
+static int adxl345_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct adxl345_file *ctx = file->private_data;
+    int ret;
+
+    ret = adxl345_file_enter(ctx, false);
+    if (ret)
+        return ret;
+    ret = adxl345_file_mmap(file, vma);
+    adxl345_file_leave(ctx);
+    return ret;
+}
+
+static const struct file_operations adxl345_fops = {
+    .owner = THIS_MODULE,
+    .open = adxl345_open,
+    .release = adxl345_release,
+    .read_iter = adxl345_read_iter,
+    .poll = adxl345_poll,
+    .fasync = adxl345_fasync,
+    .mmap = adxl345_mmap,
+    .unlocked_ioctl = adxl345_ioctl, // Déclarez la fonction ioctl
+};
+
+// static int adxl345_read_reg(struct i2c_client *client, u8 reg_addr, u8* value){
+//     int ret;
+
+//     // Écrire l'adresse du registre DEVID sur le bus I2C
+//     ret = i2c_master_send(client, &reg_addr, 1);
+//     if (ret < 0) {
+//         pr_err("Failed to set register address to ADXL345: %d\n", ret);
+//         return ret;
+//     }
+
+//     // Lire la valeur du registre DEVID
+//     ret = i2c_master_recv(client, value, 1);
+//     if (ret < 0) {
+//         pr_err("Failed to read register from ADXL345: %d\n", ret);
+//         return ret;
+//     }
+//     return 0;
+// }
+
+/*
+ * Moteur de vidange de la FIFO matérielle.
+ *
+ * Au lieu d'une paire i2c_master_send/i2c_master_recv par registre (STOP
+ * puis START à chaque fois), on prépare un tableau de messages pour un seul
+ * i2c_transfer() : pour chaque entrée de la FIFO, une écriture de l'adresse
+ * DATAX0 suivie d'une lecture de 6 octets en START répété, puis en fin de
+ * lot une lecture de FIFO_STATUS. Le nombre d'entrées retourné par ce
+ * FIFO_STATUS final dimensionne le lot suivant.
+ */
+static void adxl345_drain_build(struct adxl345_device *dev, unsigned int n)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    struct i2c_msg *msg = dev->drain_msgs;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        msg->addr = client->addr;
+        msg->flags = client->flags & I2C_M_TEN;
+        msg->len = 1;
+        msg->buf = &dev->reg_datax0;
+        msg++;
+
+        msg->addr = client->addr;
+        msg->flags = (client->flags & I2C_M_TEN) | I2C_M_RD;
+        msg->len = 6;
+        msg->buf = dev->drain_data[i];
+        msg++;
+    }
+
+    // FIFO_STATUS en fin de lot : entrées restantes après ces lectures
+    msg->addr = client->addr;
+    msg->flags = client->flags & I2C_M_TEN;
+    msg->len = 1;
+    msg->buf = &dev->reg_fifo_status;
+    msg++;
+
+    msg->addr = client->addr;
+    msg->flags = (client->flags & I2C_M_TEN) | I2C_M_RD;
+    msg->len = 1;
+    msg->buf = &dev->fifo_status;
+}
+
+static unsigned int adxl345_drain_max_entries(struct i2c_adapter *adap)
+{
+    unsigned int max = ADXL345_HW_FIFO_DEPTH;
+
+    // Certains contrôleurs limitent le nombre de messages par transfert
+    if (adap->quirks && adap->quirks->max_num_msgs) {
+        if (adap->quirks->max_num_msgs < 4)
+            return 0; // Pas même une entrée + FIFO_STATUS par transfert
+        max = min_t(unsigned int, max, (adap->quirks->max_num_msgs - 2) / 2);
+    }
+
+    return max;
+}
+
+/*
+ * Lit n entrées de la FIFO puis FIFO_STATUS. Si le contrôleur accepte les
+ * transferts groupés, un seul i2c_transfer() ; sinon une lecture groupée
+ * DATAX0..DATAZ1 par entrée via regmap.
+ */
+static int adxl345_drain_xfer(struct adxl345_device *dev, unsigned int n, bool batched)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    unsigned int status, i;
+    int num, ret;
+
+    if (batched) {
+        adxl345_drain_build(dev, n);
+        num = 2 * n + 2;
+        ret = i2c_transfer(client->adapter, dev->drain_msgs, num);
+        return ret == num ? 0 : (ret < 0 ? ret : -EIO);
+    }
+
+    for (i = 0; i < n; i++) {
+        ret = regmap_bulk_read(dev->regmap, ADXL345_REG_DATAX0, dev->drain_data[i],
+                               sizeof(dev->drain_data[i]));
+        if (ret)
+            return ret;
+    }
+
+    ret = regmap_read(dev->regmap, ADXL345_REG_FIFO_STATUS, &status);
+    if (!ret)
+        dev->fifo_status = status;
+    return ret;
+}
+
+static void adxl345_unpack_sample(const u8 *data, struct adxl345_sample_ext *sample)
+{
+    sample->x = (data[1] << 8) | data[0];  // DATAX1 (MSB) et DATAX0 (LSB)
+    sample->y = (data[3] << 8) | data[2];  // DATAY1 (MSB) et DATAY0 (LSB)
+    sample->z = (data[5] << 8) | data[4];  // DATAZ1 (MSB) et DATAZ0 (LSB)
+}
+
+/*
+ * Filtre les n échantillons vidés, sur place, et retourne le nombre
+ * d'échantillons produits (au plus n). Chaque sortie reprend l'horodatage
+ * de l'échantillon le plus récent qu'elle intègre. L'historique
+ * manquant au démarrage compte pour zéro dans le FIR. Producteur uniquement.
+ */
+static unsigned int adxl345_filter_run(struct adxl345_device *dev,
+                                       struct adxl345_sample_ext *samples, unsigned int n)
+{
+    const struct adxl345_filter *f = &dev->filter;
+    typeof(dev->filter_state) *st = &dev->filter_state;
+    const unsigned int mask = ADXL345_FILTER_MAX_TAPS - 1;
+    unsigned int i, k, a, out = 0;
+    s16 in[3];
+    s64 sum[3];
+
+    if (f->type == ADXL345_FILTER_NONE)
+        return n;
+
+    for (i = 0; i < n; i++) {
+        in[0] = samples[i].x;
+        in[1] = samples[i].y;
+        in[2] = samples[i].z;
+
+        st->pos = (st->pos + 1) & mask;
+        for (a = 0; a < 3; a++) {
+            st->hist[a][st->pos] = in[a];
+            st->acc[a] += in[a];
+        }
+        if (st->fill < ADXL345_FILTER_MAX_TAPS)
+            st->fill++;
+
+        if (++st->phase < f->decimation)
+            continue;
+        st->phase = 0;
+
+        for (a = 0; a < 3; a++) {
+            sum[a] = 0;
+            switch (f->type) {
+            case ADXL345_FILTER_MOVING_AVG:
+                for (k = 0; k < min(f->taps, st->fill); k++)
+                    sum[a] += st->hist[a][(st->pos - k) & mask];
+                sum[a] = div_s64(sum[a], min(f->taps, st->fill));
+                break;
+            case ADXL345_FILTER_BOXCAR:
+                sum[a] = st->acc[a] / (s32)f->decimation;
+                break;
+            case ADXL345_FILTER_FIR:
+                for (k = 0; k < f->taps; k++)
+                    sum[a] += (s32)f->coeffs[k] * st->hist[a][(st->pos - k) & mask];
+                sum[a] >>= f->shift;
+                break;
+            }
+            st->acc[a] = 0;
+        }
+
+        samples[out] = samples[i];
+        samples[out].x = clamp_t(s64, sum[0], S16_MIN, S16_MAX);
+        samples[out].y = clamp_t(s64, sum[1], S16_MIN, S16_MAX);
+        samples[out].z = clamp_t(s64, sum[2], S16_MIN, S16_MAX);
+        out++;
+    }
+
+    return out;
+}
+
+// Capture en mode trigger : la FIFO matérielle est réservée au déclenchement
+static bool adxl345_capture_hw(struct adxl345_device *dev)
+{
+    return dev->capture.trigger && !(dev->capture.flags & ADXL345_CAPTURE_STREAM);
+}
+
+// Publie les count derniers échantillons reçus comme une capture
+static void adxl345_capture_emit(struct adxl345_device *dev, unsigned int count)
+{
+    typeof(dev->capture_state) *st = &dev->capture_state;
+    const struct adxl345_sample_ext *s;
+    struct adxl345_capture *rec;
+    unsigned int i;
+
+    spin_lock(&dev->capture_lock);
+    rec = &dev->capture_ring[dev->capture_head & (ADXL345_CAPTURE_RING - 1)];
+    memset(rec, 0, sizeof(*rec));
+    for (i = 0; i < count; i++) {
+        s = &st->hist[(st->pos - count + i) % ADXL345_FIFO_SIZE];
+        if (!i)
+            rec->timestamp = s->timestamp;
+        rec->samples[i].x = s->x;
+        rec->samples[i].y = s->y;
+        rec->samples[i].z = s->z;
+    }
+    rec->trigger = st->trigger;
+    rec->period_ns = dev->odr_period_ns;
+    rec->seq = dev->capture_head;
+    rec->source = st->source;
+    rec->act_tap_status = st->act_tap_status;
+    rec->pre_samples = count - st->post;
+    rec->count = count;
+    WRITE_ONCE(dev->capture_head, dev->capture_head + 1);
+    // Fenêtre refermée : le thread d'interruption peut de nouveau déclencher
+    st->armed = false;
+    spin_unlock(&dev->capture_lock);
+
+    atomic64_inc(&dev->stats.captures);
+}
+
+/*
+ * Fait passer n échantillons bruts (avant filtrage) par la fenêtre de
+ * capture. Une fois armée, la fenêtre est complète quand elle contient
+ * ADXL345_FIFO_SIZE - pre_samples échantillons mesurés depuis le
+ * déclenchement. Producteur uniquement : en scrutation, la vidange tourne
+ * sans masquer l'interruption, le déclenchement noté par le thread
+ * d'interruption n'est donc armé qu'ici, sous capture_lock. Retourne vrai
+ * si une capture a été publiée.
+ */
+static bool adxl345_capture_feed(struct adxl345_device *dev,
+                                 const struct adxl345_sample_ext *samples, unsigned int n)
+{
+    typeof(dev->capture_state) *st = &dev->capture_state;
+    unsigned int i, post = ADXL345_FIFO_SIZE - dev->capture.pre_samples;
+    bool done = false;
+
+    spin_lock(&dev->capture_lock);
+    if (st->pending) {
+        st->pending = false;
+        st->armed = true;
+        st->post = 0;
+    }
+    spin_unlock(&dev->capture_lock);
+
+    for (i = 0; i < n; i++) {
+        st->hist[st->pos] = samples[i];
+        st->pos = (st->pos + 1) % ADXL345_FIFO_SIZE;
+        if (st->fill < ADXL345_FIFO_SIZE)
+            st->fill++;
+
+        if (!st->armed || samples[i].timestamp < st->trigger)
+            continue;
+        if (++st->post < post)
+            continue;
+
+        adxl345_capture_emit(dev, min(st->fill, st->post + dev->capture.pre_samples));
+        done = true;
+    }
+
+    return done;
+}
+
+/*
+ * Horodatage du premier échantillon d'une vidange. Si la vidange précédente
+ * a laissé la FIFO sous le watermark, l'interruption correspond au
+ * franchissement du seuil : le plus récent des watermark échantillons alors
+ * présents a été mesuré à l'instant du front, les autres une période plus
+ * tôt chacun. Sinon (interruption rejouée, pas de front), on prolonge la
+ * série précédente à la période configurée.
+ */
+static s64 adxl345_first_timestamp(struct adxl345_device *dev, s64 edge)
+{
+    s64 period = dev->odr_period_ns;
+    s64 ts;
+
+    if (edge && dev->watermark && dev->fifo_hint < dev->watermark)
+        ts = edge - (s64)(dev->watermark - 1) * period;
+    else if (dev->last_timestamp)
+        ts = dev->last_timestamp + period;
+    else
+        ts = ktime_get_ns() - (s64)dev->fifo_hint * period;
+
+    // Les horodatages restent strictement croissants
+    if (dev->last_timestamp && ts <= dev->last_timestamp)
+        ts = dev->last_timestamp + 1;
+
+    return ts;
+}
+
+/*
+ * Vide la FIFO matérielle par lots. Le premier lot lit dev->fifo_hint
+ * échantillons, borne inférieure des entrées présentes (rien d'autre que ce
+ * pilote ne consomme la FIFO matérielle, elle ne peut que se remplir
+ * entre deux vidanges). edge est l'instant du front d'interruption
+ * watermark, 0 si inconnu : la FIFO contient alors au moins watermark
+ * entrées, et le régime établi tient en un seul i2c_transfer(). Retourne le
+ * nombre d'échantillons lus.
+ */
+static int adxl345_drain(struct adxl345_device *dev, s64 edge)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    unsigned int max = adxl345_drain_max_entries(client->adapter);
+    bool batched = max != 0;
+    unsigned int n, fifo_entries = dev->fifo_hint;
+    unsigned int entries = 0;
+    int rounds, ret, total = 0;
+    unsigned int i;
+    s64 period = dev->odr_period_ns;
+    s64 first_ts, irq_latency;
+    u64 t0, bus_ns = 0;
+
+    // Mode trigger : la FIFO garde la fenêtre, capture_work seul la lit
+    if (adxl345_capture_hw(dev)) {
+        dev->fifo_hint = 0;
+        return 0;
+    }
+
+    if (!batched)
+        max = ADXL345_HW_FIFO_DEPTH;
+    n = min(edge ? max(dev->fifo_hint, dev->watermark) : dev->fifo_hint, max);
+
+    irq_latency = edge ? ktime_get_ns() - edge : 0;
+    if (edge)
+        adxl345_hist_add(&dev->stats.irq_latency, irq_latency);
+
+    first_ts = adxl345_first_timestamp(dev, edge);
+
+    for (rounds = 0; rounds < ADXL345_DRAIN_MAX_ROUNDS; rounds++) {
+        // Backpressure : ne sortir de la FIFO que ce que l'anneau peut garder
+        if (READ_ONCE(dev->overrun_policy) == ADXL345_OVERRUN_BACKPRESSURE) {
+            n = min(n, adxl345_ring_space(dev));
+            if (!n && rounds)
+                break;
+        }
+
+        t0 = ktime_get_ns();
+        ret = adxl345_drain_xfer(dev, n, batched);
+        t0 = ktime_get_ns() - t0;
+        bus_ns += t0;
+        adxl345_hist_add(&dev->stats.i2c_time, t0);
+        if (ret) {
+            atomic64_inc(&dev->stats.i2c_errors);
+            pr_err_ratelimited("Failed to drain FIFO (%u entries): %d\n", n, ret);
+            dev->fifo_hint = 0;
+            return ret;
+        }
+
+        for (i = 0; i < n; i++) {
+            adxl345_unpack_sample(dev->drain_data[i], &dev->drain_samples[i]);
+            dev->drain_samples[i].timestamp = first_ts + (s64)(total + i) * period;
+        }
+        if (n) {
+            dev->last_timestamp = dev->drain_samples[n - 1].timestamp;
+            raw_write_seqcount_begin(&dev->latest_seq);
+            dev->latest = dev->drain_samples[n - 1];
+            dev->latest.seq = dev->measured + total + n - 1;
+            dev->latest.flags = 0;
+            dev->latest.reserved = 0;
+            raw_write_seqcount_end(&dev->latest_seq);
+        }
+        if (dev->capture.trigger)
+            adxl345_capture_feed(dev, dev->drain_samples, n);
+        adxl345_ring_push(dev, dev->drain_samples,
+                          adxl345_filter_run(dev, dev->drain_samples, n));
+        total += n;
+
+        entries = dev->fifo_status & ADXL345_FIFO_ENTRIES_MASK;
+        // Occupation au moment de l'interruption : lus + restants au premier tour
+        if (edge && !rounds)
+            adxl345_hist_add(&dev->stats.fifo_entries, n + entries);
+        if (!entries)
+            break;
+        n = min(entries, max);
+    }
+
+    dev->fifo_hint = entries;
+    dev->measured += total;
+    atomic64_add(total, &dev->stats.drained);
+    trace_adxl345_drain(dev->miscdev.name, fifo_entries, total, entries, bus_ns, irq_latency);
+    return total;
+}
+
+/*
+ * Valeur de FIFO_CTL à écrire : en mode trigger pour la capture (le
+ * déclenchement arrive sur INT1, où INT_MAP envoie toutes les sources), en
+ * mode FIFO tant que le flux est suspendu.
+ */
+static u8 adxl345_fifo_ctl_hw(struct adxl345_device *dev, u8 fifo_ctl)
+{
+    if (adxl345_capture_hw(dev))
+        return ADXL345_FIFO_MODE_TRIGGER | dev->capture.pre_samples;
+    if (dev->paused)
+        return (fifo_ctl & ~ADXL345_FIFO_MODE_MASK) | ADXL345_FIFO_MODE_FIFO;
+    return fifo_ctl;
+}
+
+/*
+ * INT_ENABLE : watermark (sauf en mode trigger, où la FIFO ne se vide
+ * plus, en mode scrutation, où elle est vidée sur minuterie, et pendant
+ * une pause du backpressure), détecteurs publiés et déclencheurs de capture.
+ */
+static u8 adxl345_int_enable(struct adxl345_device *dev, u32 events)
+{
+    bool watermark = !adxl345_capture_hw(dev) && !dev->polling && !dev->paused;
+
+    return (watermark ? ADXL345_INT_WATERMARK : 0) | events | dev->capture.trigger;
+}
+
+/*
+ * Backpressure : l'anneau ne peut plus absorber une FIFO pleine. La FIFO
+ * matérielle passe en mode FIFO (elle garde les 32 échantillons qui suivent
+ * et cesse d'acquérir) et seule la source watermark est masquée dans
+ * INT_ENABLE, comme en scrutation, jusqu'à ce que les lecteurs aient fait
+ * de la place : les événements et les déclencheurs de capture continuent
+ * d'arriver, datés de leur front. Appelée depuis le thread d'interruption :
+ * pas d'attente sur config_lock (voir adxl345_write_config).
+ */
+static void adxl345_pause_stream(struct adxl345_device *dev)
+{
+    int ret;
+
+    if (!mutex_trylock(&dev->config_lock))
+        return;
+    if (!dev->paused) {
+        dev->paused = true;
+        ret = regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                           adxl345_int_enable(dev, dev->events.enable));
+        if (!ret)
+            ret = regmap_write(dev->regmap, ADXL345_REG_FIFO_CTL,
+                               adxl345_fifo_ctl_hw(dev, dev->fifo_ctl));
+        if (ret) {
+            atomic64_inc(&dev->stats.i2c_errors);
+            dev->paused = false;
+            regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                         adxl345_int_enable(dev, dev->events.enable));
+        }
+    }
+    mutex_unlock(&dev->config_lock);
+}
+
+/*
+ * Reprise du flux quand l'anneau a retrouvé de la place (au moins la moitié,
+ * et toujours de quoi vider la FIFO), ou sans condition si force. Les
+ * échantillons gardés par la FIFO sont vidés, puis ceux que le capteur n'a
+ * pas acquis pendant la pause sont comptés comme jetés.
+ */
+static void adxl345_resume_stream(struct adxl345_device *dev, bool force)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    u32 threshold = max_t(u32, READ_ONCE(dev->ring_size) / 2, ADXL345_RING_MAX_BATCH);
+    u64 lost = 0;
+    int ret;
+
+    if (!READ_ONCE(dev->paused) || (!force && adxl345_ring_space(dev) < threshold))
+        return;
+
+    mutex_lock(&dev->config_lock);
+    if (dev->paused) {
+        // Pas de vidange concurrente par le thread d'interruption
+        disable_irq(client->irq);
+        adxl345_drain(dev, 0);
+        if (dev->last_timestamp && ktime_get_ns() > dev->last_timestamp)
+            lost = div64_u64(ktime_get_ns() - dev->last_timestamp, dev->odr_period_ns);
+
+        dev->paused = false;
+        ret = regmap_write(dev->regmap, ADXL345_REG_FIFO_CTL,
+                           adxl345_fifo_ctl_hw(dev, dev->fifo_ctl));
+        if (!ret)
+            ret = regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                               adxl345_int_enable(dev, dev->events.enable));
+        if (ret) {
+            // Nouvelle tentative à la prochaine lecture
+            atomic64_inc(&dev->stats.i2c_errors);
+            dev->paused = true;
+        } else if (lost > 1) {
+            adxl345_ring_drop(dev, lost - 1);
+        }
+        enable_irq(client->irq);
+    }
+    mutex_unlock(&dev->config_lock);
+
+    adxl345_wake(dev);
+    adxl345_merge_wake();
+}
+
+/*
+ * Écrit FIFO_CTL en repassant par le mode bypass, qui vide la FIFO. En mode
+ * trigger, c'est ce qui réarme le déclenchement : un seul est pris en
+ * compte tant que la FIFO n'est pas repassée par le mode bypass.
+ */
+static int adxl345_fifo_rearm(struct adxl345_device *dev)
+{
+    int ret;
+
+    ret = regmap_write(dev->regmap, ADXL345_REG_FIFO_CTL, 0);
+    if (!ret)
+        ret = regmap_write(dev->regmap, ADXL345_REG_FIFO_CTL,
+                           adxl345_fifo_ctl_hw(dev, dev->fifo_ctl));
+    return ret;
+}
+
+// Délai avant que la FIFO figée soit pleine, en comptant depuis le front
+static unsigned long adxl345_capture_delay(struct adxl345_device *dev, unsigned int entries)
+{
+    u64 wait = (u64)(ADXL345_FIFO_SIZE - entries) * dev->odr_period_ns;
+
+    return nsecs_to_jiffies(wait) + 1;
+}
+
+/*
+ * Mode trigger : une fois la FIFO pleine (pre_samples échantillons d'avant
+ * le déclenchement, les suivants jusqu'à ADXL345_FIFO_SIZE), la lire d'un
+ * bloc, publier la capture et réarmer. L'interruption est masquée pendant
+ * la lecture : seul producteur.
+ */
+static void adxl345_capture_work(struct work_struct *work)
+{
+    struct adxl345_device *dev = container_of(to_delayed_work(work), struct adxl345_device,
+                                              capture_work);
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    unsigned int max = adxl345_drain_max_entries(client->adapter);
+    unsigned int entries, status, n, i, total = 0;
+    s64 ts;
+    int ret, arm;
+
+    mutex_lock(&dev->config_lock);
+    if (!adxl345_capture_hw(dev) || !dev->capture_state.armed) {
+        mutex_unlock(&dev->config_lock);
+        return;
+    }
+    disable_irq(client->irq);
+
+    ret = regmap_read(dev->regmap, ADXL345_REG_FIFO_STATUS, &status);
+    entries = status & ADXL345_FIFO_ENTRIES_MASK;
+    if (!ret && entries < ADXL345_FIFO_SIZE) {
+        // Fenêtre pas encore complète (période sous-estimée) : repasser plus tard
+        schedule_delayed_work(&dev->capture_work, adxl345_capture_delay(dev, entries));
+        goto out;
+    }
+
+    /*
+     * Le premier échantillon suivant le déclenchement est daté du front, les
+     * pre_samples qui le précèdent une période plus tôt chacun.
+     */
+    ts = dev->capture_state.trigger - (s64)dev->capture.pre_samples * dev->odr_period_ns;
+    while (!ret && total < entries) {
+        n = min(entries - total, max ? max : ADXL345_HW_FIFO_DEPTH);
+        ret = adxl345_drain_xfer(dev, n, max != 0);
+        for (i = 0; !ret && i < n; i++) {
+            adxl345_unpack_sample(dev->drain_data[i], &dev->drain_samples[i]);
+            dev->drain_samples[i].timestamp = ts + (s64)(total + i) * dev->odr_period_ns;
+        }
+        if (!ret)
+            adxl345_capture_feed(dev, dev->drain_samples, n);
+        total += n;
+    }
+    atomic64_add(total, &dev->stats.drained);
+
+    // Réarmer même après une erreur, sinon plus aucun déclenchement
+    dev->capture_state.armed = false;
+    arm = adxl345_fifo_rearm(dev);
+    if (!ret)
+        ret = arm;
+out:
+    enable_irq(client->irq);
+    mutex_unlock(&dev->config_lock);
+
+    if (ret) {
+        atomic64_inc(&dev->stats.i2c_errors);
+        pr_err_ratelimited("Failed to read ADXL345 capture: %d\n", ret);
+    }
+    adxl345_wake(dev);
+    kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+}
+
+static void adxl345_resume_work(struct work_struct *work)
+{
+    adxl345_resume_stream(container_of(work, struct adxl345_device, resume_work), false);
+}
+
+// static irqreturn_t adxl345_irq_handler(int irq, void *dev_id)
+// {
+//     struct adxl345_device *dev = dev_id;
+//     struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+//     struct adxl345_sample sample;
+//     u8 fifo_status;
+//     int ret;
+
+//     // pr_info("Enter ADXL345 interrupt function\n");
+
+//     // Lire le registre FIFO_STATUS pour connaître le nombre d'échantillons
+//     ret = adxl345_read_reg(client, 0x39, &fifo_status);
+//     if (ret < 0) {
+//         pr_err("Failed to read FIFO_STATUS: %d\n", ret);
+//         return IRQ_NONE;
+//     }
+
+//     // Vider la FIFO matérielle dans la FIFO logicielle
+//     while (fifo_status & 0x1F) { // FIFO Entries dans les 5 bits de poids faible
+//         ret = adxl345_read_fifo_sample(client, &sample);
+//         if (ret < 0) {
+//             pr_err("Failed to read sample from FIFO\n");
+//             break;
+//         }
+
+//         if (!kfifo_put(&dev->samples_fifo, sample))
+//             pr_warn("Driver FIFO full, dropping sample\n");
+
+//         fifo_status--;
+//     }
+
+//     // Réveiller les processus en attente
+//     wake_up_interruptible(&dev->wait_queue);
+
+//     return IRQ_HANDLED;
+// }
+
+/*
+ * Watermark adaptatif. Toutes les ADXL345_ADAPT_PERIOD vidanges, le seuil
+ * est recalculé pour qu'une interruption apporte à peu près ce que le
+ * lecteur le plus rapide consomme entre deux lectures : interrompre plus
+ * souvent ne ferait que réveiller le pilote pour rien. Le seuil ne dépasse
+ * jamais le budget de latence, et l'atteint quand aucun lecteur n'est actif
+ * ou que les lecteurs ont déjà du retard (anneau plus qu'à moitié plein).
+ * Appelée depuis le thread d'interruption, après la vidange.
+ */
+static void adxl345_adapt_watermark(struct adxl345_device *dev)
+{
+    struct adxl345_file *ctx;
+    u64 period = dev->odr_period_ns;
+    u64 cadence = U64_MAX;
+    u32 backlog = 0, budget, target;
+    u8 fifo_ctl;
+
+    if (!READ_ONCE(dev->adaptive) || ++dev->adapt_count < ADXL345_ADAPT_PERIOD)
+        return;
+    dev->adapt_count = 0;
+
+    budget = clamp_t(u64, div64_u64(READ_ONCE(dev->latency_budget_ns), period),
+                     1, ADXL345_ADAPT_MAX_WATERMARK);
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(ctx, &dev->readers, list) {
+        u64 interval = READ_ONCE(ctx->read_interval_ns);
+
+        if (!adxl345_file_samples(ctx))
+            continue;
+        if (interval)
+            cadence = min(cadence, interval);
+        backlog = max(backlog, adxl345_file_pending(ctx));
+    }
+    rcu_read_unlock();
+
+    if (cadence == U64_MAX || backlog > dev->ring_size / 2)
+        target = budget;
+    else
+        target = clamp_t(u64, div64_u64(cadence, period), 1, budget);
+
+    // Baisser tout de suite (latence), monter seulement par paliers de 2
+    if (target == dev->watermark || target == dev->watermark + 1)
+        return;
+    if (target > dev->watermark)
+        target = dev->watermark + 2;
+
+    // Une reconfiguration par ioctl attend la fin de ce thread : ne pas bloquer
+    if (!mutex_trylock(&dev->config_lock))
+        return;
+    fifo_ctl = (dev->fifo_ctl & ~ADXL345_FIFO_SAMPLES_MASK) | target;
+    if (!regmap_write(dev->regmap, ADXL345_REG_FIFO_CTL,
+                                   adxl345_fifo_ctl_hw(dev, fifo_ctl))) {
+        dev->fifo_ctl = fifo_ctl;
+        dev->watermark = target;
+    }
+    mutex_unlock(&dev->config_lock);
+}
+
+/*
+ * Sources d'événement de l'interruption. ACT_TAP_STATUS est lu avant
+ * INT_SOURCE, dont la lecture acquitte les événements (et relâche la ligne
+ * d'interruption). Un enregistrement par interruption, toutes sources
+ * confondues, daté du front. Un déclencheur de capture arme la fenêtre s'il
+ * n'y en a pas déjà une en cours (en flux, par la vidange suivante). Retourne vrai si un événement a été
+ * publié ; *int_source reçoit INT_SOURCE tel que lu (sans détecteur actif,
+ * le watermark est la seule source possible et le registre n'est pas lu).
+ */
+static bool adxl345_handle_events(struct adxl345_device *dev, unsigned int *int_source)
+{
+    unsigned int source, status = 0;
+    struct adxl345_event *ev;
+    s64 ts = dev->irq_timestamp ? dev->irq_timestamp : ktime_get_ns();
+    u8 enable = READ_ONCE(dev->events.enable) | dev->capture.trigger;
+
+    *int_source = ADXL345_INT_WATERMARK;
+    if (!enable)
+        return false;
+
+    *int_source = 0;
+    if (enable & (ADXL345_EVENT_SINGLE_TAP | ADXL345_EVENT_DOUBLE_TAP | ADXL345_EVENT_ACTIVITY) &&
+        regmap_read(dev->regmap, ADXL345_REG_ACT_TAP_STATUS, &status))
+        goto err;
+    if (regmap_read(dev->regmap, ADXL345_REG_INT_SOURCE, &source))
+        goto err;
+    *int_source = source;
+
+    if (source & dev->capture.trigger) {
+        spin_lock(&dev->capture_lock);
+        if (!dev->capture_state.armed && !dev->capture_state.pending) {
+            dev->capture_state.trigger = ts;
+            dev->capture_state.source = source & dev->capture.trigger;
+            dev->capture_state.act_tap_status = status;
+            // En flux, la fenêtre (post) appartient à la vidange
+            if (adxl345_capture_hw(dev)) {
+                dev->capture_state.armed = true;
+                dev->capture_state.post = 0;
+            } else {
+                dev->capture_state.pending = true;
+            }
+        }
+        spin_unlock(&dev->capture_lock);
+    }
+
+    source &= READ_ONCE(dev->events.enable);
+    if (!source)
+        return false;
+
+    spin_lock(&dev->event_lock);
+    ev = &dev->event_ring[dev->event_head & (ADXL345_EVENT_RING - 1)];
+    ev->timestamp = ts;
+    ev->seq = dev->event_head;
+    ev->source = source;
+    ev->act_tap_status = status;
+    ev->reserved = 0;
+    WRITE_ONCE(dev->event_head, dev->event_head + 1);
+    spin_unlock(&dev->event_lock);
+
+    atomic64_inc(&dev->stats.events);
+    return true;
+
+err:
+    atomic64_inc(&dev->stats.i2c_errors);
+    pr_err_ratelimited("Failed to read ADXL345 interrupt source\n");
+    return false;
+}
+
+/*
+ * Gestionnaire primaire : ne fait que dater le front d'interruption, avant
+ * la latence d'ordonnancement du thread qui vide la FIFO.
+ */
+static irqreturn_t adxl345_irq_edge(int irq, void *dev_id)
+{
+    struct adxl345_device *dev = dev_id;
+
+    dev->irq_timestamp = ktime_get_ns();
+    return IRQ_WAKE_THREAD;
+}
+
+// Période de scrutation : le budget de latence, sans laisser déborder la FIFO
+static u64 adxl345_poll_period(struct adxl345_device *dev)
+{
+    return clamp_t(u64, READ_ONCE(dev->latency_budget_ns), dev->odr_period_ns,
+                   ADXL345_ADAPT_MAX_WATERMARK * dev->odr_period_ns);
+}
+
+/*
+ * Retour aux interruptions, avec config_lock : quand la configuration ne
+ * produirait plus assez d'interruptions pour justifier la scrutation
+ * (moitié du seuil, pour ne pas osciller), en mode trigger, ou quand la
+ * backpressure doit suspendre la FIFO, ce que seul le chemin d'interruption
+ * sait faire.
+ */
+static bool adxl345_poll_should_stop(struct adxl345_device *dev)
+{
+    unsigned int threshold = READ_ONCE(dev->poll_threshold_hz);
+
+    if (!threshold || adxl345_capture_hw(dev))
+        return true;
+    if (READ_ONCE(dev->overrun_policy) == ADXL345_OVERRUN_BACKPRESSURE &&
+        adxl345_ring_space(dev) < ADXL345_RING_MAX_BATCH)
+        return true;
+    return ADXL345_RATE_HZ(dev->bw_rate) / dev->watermark < threshold / 2;
+}
+
+static void adxl345_poll_stop(struct adxl345_device *dev)
+{
+    lockdep_assert_held(&dev->config_lock);
+
+    if (!dev->polling)
+        return;
+    dev->polling = false;
+    dev->last_edge = 0;
+    dev->irq_interval_ns = 0;
+    if (regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                     adxl345_int_enable(dev, dev->events.enable)))
+        atomic64_inc(&dev->stats.i2c_errors);
+}
+
+/*
+ * Vidange à la demande pour ADXL345_GET_LATEST. Faux si la FIFO est figée
+ * (capture matérielle, pause de backpressure) : le cache n'est alors pas
+ * le dernier échantillon mesuré.
+ */
+static bool adxl345_latest_refresh(struct adxl345_device *dev)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+
+    mutex_lock(&dev->config_lock);
+    if (adxl345_capture_hw(dev) || dev->paused) {
+        mutex_unlock(&dev->config_lock);
+        return false;
+    }
+    disable_irq(client->irq);
+    adxl345_drain(dev, 0);
+    enable_irq(client->irq);
+    mutex_unlock(&dev->config_lock);
+
+    adxl345_wake(dev);
+    kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+    adxl345_merge_wake();
+    return true;
+}
+
+/*
+ * Vidange sur minuterie. Sans front d'interruption, les horodatages
+ * prolongent la série précédente ; pour ne pas dériver avec l'horloge du
+ * capteur, la base est recalée d'un huitième de l'écart avec l'estimation
+ * tirée des entrées restantes (la plus récente a moins d'une période).
+ */
+static void adxl345_poll_work(struct work_struct *work)
+{
+    struct adxl345_device *dev = container_of(work, struct adxl345_device, poll_work);
+    s64 estimate, elapsed;
+    u64 entries;
+
+    mutex_lock(&dev->config_lock);
+    if (!dev->polling) {
+        mutex_unlock(&dev->config_lock);
+        return;
+    }
+
+    atomic64_inc(&dev->stats.polls);
+
+    /*
+     * La vidange précédente a vidé la FIFO : fifo_hint vaut presque toujours
+     * 0. Ce qui a été mesuré depuis le dernier échantillon vidé, moins un
+     * de marge contre l'erreur de l'horodatage, est une borne inférieure des
+     * entrées présentes : un seul i2c_transfer() par scrutation.
+     */
+    elapsed = ktime_get_ns() - dev->last_timestamp;
+    if (dev->last_timestamp && elapsed > 0) {
+        entries = div64_u64(elapsed, dev->odr_period_ns);
+        if (entries > 1)
+            dev->fifo_hint = max_t(u64, dev->fifo_hint,
+                                   min_t(u64, entries - 1, ADXL345_FIFO_SIZE));
+    }
+
+    if (adxl345_drain(dev, 0) > 0) {
+        estimate = ktime_get_ns() - (s64)dev->fifo_hint * dev->odr_period_ns -
+                   dev->odr_period_ns / 2;
+        dev->last_timestamp += (estimate - dev->last_timestamp) / 8;
+    }
+
+    if (adxl345_poll_should_stop(dev))
+        adxl345_poll_stop(dev);
+    else
+        hrtimer_start(&dev->poll_timer, ns_to_ktime(adxl345_poll_period(dev)),
+                      HRTIMER_MODE_REL);
+    mutex_unlock(&dev->config_lock);
+
+    adxl345_wake(dev);
+    kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+    adxl345_merge_wake();
+}
+
+// Contexte d'interruption : le bus I2C se manipule depuis poll_work
+static enum hrtimer_restart adxl345_poll_timer(struct hrtimer *timer)
+{
+    struct adxl345_device *dev = container_of(timer, struct adxl345_device, poll_timer);
+
+    queue_work(system_highpri_wq, &dev->poll_work);
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Passage en scrutation quand l'intervalle moyen entre interruptions
+ * watermark tombe sous 1 / poll_threshold_hz. Appelée depuis le thread
+ * d'interruption, après la vidange : pas d'attente sur config_lock.
+ */
+static void adxl345_poll_check(struct adxl345_device *dev, s64 edge)
+{
+    unsigned int threshold = READ_ONCE(dev->poll_threshold_hz);
+    u64 interval;
+
+    if (!edge)
+        return;
+    if (dev->last_edge && edge > dev->last_edge) {
+        interval = edge - dev->last_edge;
+        // Moyenne glissante sur environ 8 interruptions
+        dev->irq_interval_ns = dev->irq_interval_ns ?
+            dev->irq_interval_ns - (dev->irq_interval_ns >> 3) + (interval >> 3) : interval;
+    }
+    dev->last_edge = edge;
+
+    if (!threshold || !dev->irq_interval_ns ||
+        dev->irq_interval_ns * threshold >= NSEC_PER_SEC)
+        return;
+    if (!mutex_trylock(&dev->config_lock))
+        return;
+    if (!adxl345_poll_should_stop(dev)) {
+        dev->polling = true;
+        if (regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                         adxl345_int_enable(dev, dev->events.enable)))
+            dev->polling = false;
+        else
+            hrtimer_start(&dev->poll_timer, ns_to_ktime(adxl345_poll_period(dev)),
+                          HRTIMER_MODE_REL);
+    }
+    mutex_unlock(&dev->config_lock);
+}
+
+irqreturn_t adxl345_int(int irq, void *dev_id) {
+    struct adxl345_device *dev = (struct adxl345_device *)dev_id;
+    unsigned int source;
+    bool event;
+    s64 edge;
+
+    atomic64_inc(&dev->stats.irqs);
+
+    event = adxl345_handle_events(dev, &source);
+
+    // Mode trigger : pas de flux, la FIFO figée sera lue une fois pleine
+    if (adxl345_capture_hw(dev)) {
+        if (dev->capture_state.armed)
+            schedule_delayed_work(&dev->capture_work,
+                                  adxl345_capture_delay(dev, dev->capture.pre_samples));
+        if (event) {
+            adxl345_wake(dev);
+            kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+        }
+        return IRQ_HANDLED;
+    }
+
+    /*
+     * Scrutation : la FIFO est vidée par poll_work ; backpressure : elle est
+     * figée jusqu'à la reprise. Seuls les événements arrivent ici.
+     */
+    if (READ_ONCE(dev->polling) || READ_ONCE(dev->paused)) {
+        if (event) {
+            adxl345_wake(dev);
+            kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+        }
+        return IRQ_HANDLED;
+    }
+
+    /*
+     * Le front n'ancre les horodatages que pour une interruption watermark :
+     * un tap ou une chute libre arrive quel que soit le remplissage de la FIFO.
+     */
+    edge = source & ADXL345_INT_WATERMARK ? dev->irq_timestamp : 0;
+
+    // Vider la FIFO matérielle (FIFO_STATUS compris) en transferts groupés
+    if (adxl345_drain(dev, edge) < 0) {
+        if (event)
+            adxl345_wake(dev);
+        return IRQ_HANDLED;
+    }
+
+    adxl345_adapt_watermark(dev);
+    adxl345_poll_check(dev, edge);
+
+    if (READ_ONCE(dev->overrun_policy) == ADXL345_OVERRUN_BACKPRESSURE &&
+        adxl345_ring_space(dev) < ADXL345_RING_MAX_BATCH)
+        adxl345_pause_stream(dev);
+
+    // Réveiller les processus en attente
+    adxl345_wake(dev);
+    kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+    adxl345_merge_wake();
+
+    return IRQ_HANDLED;
+}
+
+/*
+ * Reconfiguration à chaud. L'interruption est masquée le temps de vider la
+ * FIFO matérielle avec l'ancienne configuration (fréquence, échelle), puis
+ * le registre est écrit : aucun échantillon n'est perdu ni mal interprété.
+ * Rien n'est fait si le cache regmap contient déjà cette valeur.
+ * Appelée avec config_lock.
+ */
+static int adxl345_write_config(struct adxl345_device *dev, u8 reg, u8 val)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    unsigned int cur;
+    int ret;
+
+    lockdep_assert_held(&dev->config_lock);
+
+    if (!regmap_read(dev->regmap, reg, &cur) && cur == val)
+        return 0;
+
+    disable_irq(client->irq);
+    adxl345_drain(dev, 0);
+    ret = regmap_write(dev->regmap, reg, val);
+    enable_irq(client->irq);
+
+    adxl345_wake(dev);
+    if (ret) {
+        atomic64_inc(&dev->stats.i2c_errors);
+        pr_err("Failed to write register 0x%02x: %d\n", reg, ret);
+    }
+    return ret;
+}
+
+// Code BW_RATE de la plus petite fréquence supportée supérieure ou égale à hz
+static u8 adxl345_rate_code(u32 hz)
+{
+    u8 code = ADXL345_RATE_MAX;
+
+    while (code > 0 && ADXL345_RATE_HZ(code - 1) >= hz)
+        code--;
+
+    return code;
+}
+
+static int adxl345_set_rate(struct adxl345_device *dev, u32 hz)
+{
+    u8 code;
+    int ret;
+
+    if (!hz || hz > ADXL345_RATE_HZ(ADXL345_RATE_MAX))
+        return -EINVAL;
+    code = adxl345_rate_code(hz);
+
+    mutex_lock(&dev->config_lock);
+    ret = adxl345_write_config(dev, ADXL345_REG_BW_RATE, code);
+    if (!ret) {
+        dev->bw_rate = code;
+        dev->odr_period_ns = ADXL345_ODR_PERIOD_NS(code);
+    }
+    mutex_unlock(&dev->config_lock);
+
+    return ret;
+}
+
+static int adxl345_set_format(struct adxl345_device *dev, u32 range_g, bool full_res)
+{
+    u8 format;
+    int ret;
+
+    if (range_g != 2 && range_g != 4 && range_g != 8 && range_g != 16)
+        return -EINVAL;
+    format = ilog2(range_g) - 1; // 2 g -> 0, ..., 16 g -> 3
+    if (full_res)
+        format |= ADXL345_DATA_FORMAT_FULL_RES;
+
+    mutex_lock(&dev->config_lock);
+    ret = adxl345_write_config(dev, ADXL345_REG_DATA_FORMAT, format);
+    if (!ret)
+        dev->data_format = format;
+    mutex_unlock(&dev->config_lock);
+
+    return ret;
+}
+
+static int adxl345_set_watermark(struct adxl345_device *dev, u32 watermark)
+{
+    u8 fifo_ctl;
+    int ret;
+
+    if (!watermark || watermark > ADXL345_FIFO_SAMPLES_MASK)
+        return -EINVAL;
+
+    mutex_lock(&dev->config_lock);
+    fifo_ctl = (dev->fifo_ctl & ~ADXL345_FIFO_SAMPLES_MASK) | watermark;
+    ret = adxl345_write_config(dev, ADXL345_REG_FIFO_CTL, adxl345_fifo_ctl_hw(dev, fifo_ctl));
+    if (!ret) {
+        dev->fifo_ctl = fifo_ctl;
+        dev->watermark = watermark;
+    }
+    mutex_unlock(&dev->config_lock);
+
+    return ret;
+}
+
+// Seuils et durées des détecteurs ; regmap n'écrit que les valeurs modifiées
+static int adxl345_write_events(struct adxl345_device *dev, const struct adxl345_events_config *ev)
+{
+    const struct {
+        unsigned int reg;
+        u8 val;
+    } regs[] = {
+        { ADXL345_REG_THRESH_TAP, ev->thresh_tap },
+        { ADXL345_REG_DUR, ev->tap_duration },
+        { ADXL345_REG_LATENT, ev->tap_latency },
+        { ADXL345_REG_WINDOW, ev->tap_window },
+        { ADXL345_REG_THRESH_ACT, ev->thresh_act },
+        { ADXL345_REG_THRESH_INACT, ev->thresh_inact },
+        { ADXL345_REG_TIME_INACT, ev->time_inact },
+        { ADXL345_REG_ACT_INACT_CTL, ev->act_inact_ctl },
+        { ADXL345_REG_THRESH_FF, ev->thresh_ff },
+        { ADXL345_REG_TIME_FF, ev->time_ff },
+        { ADXL345_REG_TAP_AXES, ev->tap_axes },
+    };
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < ARRAY_SIZE(regs); i++) {
+        ret = regmap_update_bits(dev->regmap, regs[i].reg, 0xFF, regs[i].val);
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int adxl345_set_events(struct adxl345_device *dev, const struct adxl345_events_config *events)
+{
+    int ret;
+
+    if (events->enable & ~ADXL345_EVENT_MASK)
+        return -EINVAL;
+
+    mutex_lock(&dev->config_lock);
+    ret = adxl345_write_events(dev, events);
+    if (!ret)
+        ret = adxl345_write_config(dev, ADXL345_REG_INT_ENABLE,
+                                   adxl345_int_enable(dev, events->enable));
+    if (!ret)
+        dev->events = *events;
+    mutex_unlock(&dev->config_lock);
+
+    return ret;
+}
+
+/*
+ * Entrée ou sortie du mode capture. La FIFO est vidée dans l'anneau avec
+ * l'ancienne configuration, puis FIFO_CTL repasse par le mode bypass : une
+ * fenêtre en cours est abandonnée. Les seuils des déclencheurs sont ceux
+ * des détecteurs (ADXL345_SET_EVENTS).
+ */
+static int adxl345_set_capture(struct adxl345_device *dev, const struct adxl345_capture_config *capture)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+    int ret;
+
+    if (capture->trigger & ~ADXL345_EVENT_MASK || capture->flags & ~ADXL345_CAPTURE_STREAM)
+        return -EINVAL;
+    if (capture->trigger && (!capture->pre_samples || capture->pre_samples >= ADXL345_FIFO_SIZE))
+        return -EINVAL;
+
+    // La pause du flux (backpressure) ne survit pas au changement de mode
+    adxl345_resume_stream(dev, true);
+    cancel_delayed_work_sync(&dev->capture_work);
+
+    mutex_lock(&dev->config_lock);
+    disable_irq(client->irq);
+    adxl345_drain(dev, 0);
+
+    dev->capture = *capture;
+    memset(&dev->capture_state, 0, sizeof(dev->capture_state));
+    dev->fifo_hint = 0;
+    dev->last_timestamp = 0;
+
+    ret = adxl345_fifo_rearm(dev);
+    if (!ret)
+        ret = regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                           adxl345_int_enable(dev, dev->events.enable));
+    enable_irq(client->irq);
+    mutex_unlock(&dev->config_lock);
+
+    adxl345_wake(dev);
+    if (ret) {
+        atomic64_inc(&dev->stats.i2c_errors);
+        pr_err("Failed to configure ADXL345 capture: %d\n", ret);
+    }
+    return ret;
+}
+
+/*
+ * Nouveau filtre : la FIFO est vidée à travers l'ancien, puis l'état
+ * (historique, accumulateurs) repart de zéro.
+ */
+static int adxl345_set_filter(struct adxl345_device *dev, const struct adxl345_filter *filter)
+{
+    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
+
+    if (filter->type > ADXL345_FILTER_FIR || !filter->decimation ||
+        filter->decimation > ADXL345_FILTER_MAX_DECIMATION)
+        return -EINVAL;
+    if ((filter->type == ADXL345_FILTER_MOVING_AVG || filter->type == ADXL345_FILTER_FIR) &&
+        (!filter->taps || filter->taps > ADXL345_FILTER_MAX_TAPS))
+        return -EINVAL;
+    if (filter->type == ADXL345_FILTER_FIR && filter->shift > 30)
+        return -EINVAL;
+
+    mutex_lock(&dev->config_lock);
+    disable_irq(client->irq);
+    adxl345_drain(dev, 0);
+    dev->filter = *filter;
+    memset(&dev->filter_state, 0, sizeof(dev->filter_state));
+    enable_irq(client->irq);
+    mutex_unlock(&dev->config_lock);
+
+    adxl345_wake(dev);
+    return 0;
+}
+
+static void adxl345_get_config(struct adxl345_device *dev, struct adxl345_config *cfg)
+{
+    mutex_lock(&dev->config_lock);
+    cfg->rate_hz = ADXL345_RATE_HZ(dev->bw_rate);
+    cfg->range_g = 2 << (dev->data_format & ADXL345_DATA_FORMAT_RANGE);
+    cfg->full_res = !!(dev->data_format & ADXL345_DATA_FORMAT_FULL_RES);
+    cfg->watermark = dev->watermark;
+    cfg->ring_entries = READ_ONCE(dev->ring_size);
+    mutex_unlock(&dev->config_lock);
+}
+
+/*
+ * Flux fusionné (/dev/adxl345-all). Le fichier a un lecteur sur l'anneau de
+ * chaque capteur sondé à l'ouverture, et garde d'avance le prochain
+ * échantillon de chacun. read() remet toujours le plus ancien, à condition
+ * qu'aucun capteur sans échantillon en attente ne puisse encore en publier
+ * un plus ancien (voir adxl345_merge_horizon). Les horodatages sont
+ * reconstitués par chaque vidange sur CLOCK_MONOTONIC : ils sont
+ * comparables d'un capteur à l'autre. Un capteur retiré (unbind) en cours
+ * de route est détaché par adxl345_remove() : son ctx passe à NULL.
+ */
+struct adxl345_merge_file {
+    struct list_head node;      // Dans adxl345_merge_files
+    struct mutex lock;          // Threads qui partagent ce fichier
+    s64 last_ts;                // Dernier horodatage remis
+    unsigned int count;
+    unsigned int live;          // Capteurs encore présents
+    struct {
+        struct adxl345_file *ctx;   // NULL une fois le capteur retiré
+        struct adxl345_sample_ext next; // Prochain échantillon, déjà réservé
+        bool have;
+    } src[];
+};
+
+/*
+ * Instant jusqu'auquel dev a publié tout ce qu'il a mesuré : son dernier
+ * échantillon vidé, ou, si la vidange se fait attendre, tout ce qui est
+ * plus ancien que ce que la FIFO peut retenir (watermark + 1 échantillons
+ * et la latence d'interruption). Un capteur sans flux ne retient rien.
+ */
+static s64 adxl345_merge_horizon(struct adxl345_device *dev, s64 now)
+{
+    s64 held;
+
+    if (adxl345_capture_hw(dev))
+        return S64_MAX;
+
+    held = (s64)(READ_ONCE(dev->watermark) + 1) * READ_ONCE(dev->odr_period_ns) +
+           ADXL345_MERGE_SLACK_NS;
+    return max(READ_ONCE(dev->last_timestamp), now - held);
+}
+
+/*
+ * Réserve le prochain échantillon du capteur i s'il n'est pas déjà en main.
+ * Avec nowait, un capteur en cours de redimensionnement est sauté.
+ */
+static void adxl345_merge_fill(struct adxl345_merge_file *m, unsigned int i, bool nowait)
+{
+    struct adxl345_file *ctx = m->src[i].ctx;
+    struct adxl345_sample_ext rec;
+    u32 got, skip;
+
+    if (!ctx || m->src[i].have)
+        return;
+
+    if (!nowait)
+        down_read(&ctx->dev->ring_sem);
+    else if (!down_read_trylock(&ctx->dev->ring_sem))
+        return;
+    do {
+        got = adxl345_ring_fetch(ctx, &rec, 1, &skip);
+    } while (got && skip);
+    up_read(&ctx->dev->ring_sem);
+
+    if (got) {
+        m->src[i].next = rec;
+        m->src[i].have = true;
+    }
+}
+
+/*
+ * Capteur dont l'échantillon peut être remis, ou -1. Dans ce cas, *wait_ns
+ * est le temps au bout duquel l'horizon des capteurs muets aura dépassé
+ * l'échantillon le plus ancien (0 s'il n'y en a aucun). Sous m->lock.
+ */
+static int adxl345_merge_pick(struct adxl345_merge_file *m, s64 *wait_ns, bool nowait)
+{
+    s64 now = ktime_get_ns(), limit = S64_MAX;
+    unsigned int i;
+    int best = -1;
+
+    *wait_ns = 0;
+    for (i = 0; i < m->count; i++) {
+        adxl345_merge_fill(m, i, nowait);
+        if (m->src[i].have &&
+            (best < 0 || m->src[i].next.timestamp < m->src[best].next.timestamp))
+            best = i;
+    }
+    if (best < 0)
+        return -1;
+
+    for (i = 0; i < m->count; i++) {
+        if (m->src[i].ctx && !m->src[i].have)
+            limit = min(limit, adxl345_merge_horizon(m->src[i].ctx->dev, now));
+    }
+    if (m->src[best].next.timestamp <= limit)
+        return best;
+
+    *wait_ns = m->src[best].next.timestamp - limit;
+    return -1;
+}
+
+static int adxl345_merge_open(struct inode *inode, struct file *file)
+{
+    struct adxl345_merge_file *m;
+    struct adxl345_device *dev;
+    struct adxl345_file *ctx;
+    unsigned int count = 0, i = 0;
+    int ret;
+
+    mutex_lock(&adxl345_devices_lock);
+    list_for_each_entry(dev, &adxl345_devices, node)
+        count++;
+    if (!count) {
+        mutex_unlock(&adxl345_devices_lock);
+        return -ENODEV;
+    }
+
+    m = kzalloc(struct_size(m, src, count), GFP_KERNEL);
+    if (!m) {
+        mutex_unlock(&adxl345_devices_lock);
+        return -ENOMEM;
+    }
+
+    list_for_each_entry(dev, &adxl345_devices, node) {
+        ctx = adxl345_file_attach(dev);
+        if (IS_ERR(ctx)) {
+            ret = PTR_ERR(ctx);
+            goto err;
+        }
+        m->src[i++].ctx = ctx;
+    }
+    mutex_init(&m->lock);
+    m->count = count;
+    m->live = count;
+    m->last_ts = S64_MIN;
+    list_add(&m->node, &adxl345_merge_files);
+    mutex_unlock(&adxl345_devices_lock);
+
+    file->f_mode |= FMODE_NOWAIT;
+    file->private_data = m;
+    return 0;
+
+err:
+    while (i--)
+        adxl345_file_detach(m->src[i].ctx);
+    mutex_unlock(&adxl345_devices_lock);
+    kfree(m);
+    return ret;
+}
+
+static int adxl345_merge_release(struct inode *inode, struct file *file)
+{
+    struct adxl345_merge_file *m = file->private_data;
+    unsigned int i;
+
+    // Sous adxl345_devices_lock : pas de adxl345_remove() concurrent
+    mutex_lock(&adxl345_devices_lock);
+    list_del(&m->node);
+    for (i = 0; i < m->count; i++) {
+        if (m->src[i].ctx)
+            adxl345_file_detach(m->src[i].ctx);
+    }
+    mutex_unlock(&adxl345_devices_lock);
+    kfree(m);
+    return 0;
+}
+
+/*
+ * Retrait de dev : ses lecteurs dans les fichiers /dev/adxl345-all ouverts
+ * sont détachés avant que dev ne soit libéré. Sous adxl345_devices_lock.
+ */
+static void adxl345_merge_remove(struct adxl345_device *dev)
+{
+    struct adxl345_merge_file *m;
+    unsigned int i;
+
+    lockdep_assert_held(&adxl345_devices_lock);
+
+    list_for_each_entry(m, &adxl345_merge_files, node) {
+        mutex_lock(&m->lock);
+        for (i = 0; i < m->count; i++) {
+            if (m->src[i].ctx && m->src[i].ctx->dev == dev) {
+                adxl345_file_detach(m->src[i].ctx);
+                m->src[i].ctx = NULL;
+                m->src[i].have = false;
+                m->live--;
+            }
+        }
+        mutex_unlock(&m->lock);
+    }
+
+    // Les lecteurs endormis réévaluent l'horizon sans ce capteur
+    adxl345_merge_wake();
+}
+
+static ssize_t adxl345_merge_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct file *file = iocb->ki_filp;
+    struct adxl345_merge_file *m = file->private_data;
+    struct adxl345_sample_merged recs[ADXL345_READ_CHUNK];
+    size_t max_n = iov_iter_count(to) / sizeof(recs[0]), done = 0;
+    bool nowait = adxl345_nowait(iocb);
+    const struct adxl345_sample_ext *s;
+    struct adxl345_device *dev;
+    unsigned int n, i, seen;
+    s64 wait_ns;
+    long ret;
+    int best;
+
+    if (!max_n)
+        return -EINVAL;
+
+    for (;;) {
+        seen = atomic_read(&adxl345_merge_gen);
+        if (iocb->ki_flags & IOCB_NOWAIT) {
+            if (!mutex_trylock(&m->lock))
+                return -EAGAIN;
+        } else if (mutex_lock_interruptible(&m->lock)) {
+            return -ERESTARTSYS;
+        }
+        if (!m->live) {
+            mutex_unlock(&m->lock);
+            return -ENODEV;
+        }
+
+        do {
+            for (n = 0; n < ADXL345_READ_CHUNK && done + n < max_n; n++) {
+                best = adxl345_merge_pick(m, &wait_ns, iocb->ki_flags & IOCB_NOWAIT);
+                if (best < 0)
+                    break;
+
+                s = &m->src[best].next;
+                dev = m->src[best].ctx->dev;
+                recs[n].timestamp = s->timestamp;
+                recs[n].seq = s->seq;
+                recs[n].x = s->x;
+                recs[n].y = s->y;
+                recs[n].z = s->z;
+                recs[n].flags = s->flags;
+                if (s->timestamp < m->last_ts)
+                    recs[n].flags |= ADXL345_SAMPLE_LATE;
+                recs[n].source = dev->index;
+                m->last_ts = max(m->last_ts, s->timestamp);
+                m->src[best].have = false;
+                atomic64_inc(&dev->stats.delivered);
+            }
+
+            if (n && copy_to_iter(recs, n * sizeof(recs[0]), to) != n * sizeof(recs[0])) {
+                mutex_unlock(&m->lock);
+                return done ? done * sizeof(recs[0]) : -EFAULT;
+            }
+            done += n;
+        } while (n == ADXL345_READ_CHUNK && done < max_n);
+
+        if (done)
+            break;
+        mutex_unlock(&m->lock);
+        if (nowait)
+            return -EAGAIN;
+
+        // Attendre une vidange, ou que l'horizon d'un capteur muet soit dépassé
+        ret = wait_event_interruptible_timeout(adxl345_merge_wait,
+                                               atomic_read(&adxl345_merge_gen) != seen,
+                                               wait_ns ? nsecs_to_jiffies(wait_ns) + 1 :
+                                                         MAX_SCHEDULE_TIMEOUT);
+        if (ret < 0)
+            return -ERESTARTSYS;
+    }
+
+    // Ce lecteur retenait peut-être la FIFO matérielle d'un capteur
+    for (i = 0; i < m->count; i++) {
+        if (!m->src[i].ctx)
+            continue;
+        WRITE_ONCE(m->src[i].ctx->overrun, false);
+        adxl345_file_mark_read(m->src[i].ctx);
+        adxl345_read_done(m->src[i].ctx->dev, iocb);
+    }
+    mutex_unlock(&m->lock);
+    return done * sizeof(recs[0]);
+}
+
+static __poll_t adxl345_merge_poll(struct file *file, poll_table *wait)
+{
+    struct adxl345_merge_file *m = file->private_data;
+    __poll_t mask = 0;
+    unsigned int i;
+    s64 wait_ns;
+
+    poll_wait(file, &adxl345_merge_wait, wait);
+
+    mutex_lock(&m->lock);
+    if (adxl345_merge_pick(m, &wait_ns, false) >= 0)
+        mask |= EPOLLIN | EPOLLRDNORM;
+    for (i = 0; i < m->count; i++) {
+        if (m->src[i].ctx && READ_ONCE(m->src[i].ctx->overrun))
+            mask |= EPOLLERR;
+    }
+    if (!m->live)
+        mask |= EPOLLHUP;
+    mutex_unlock(&m->lock);
+
+    return mask;
+}
 
-struct adxl345_sample {
-    int16_t x;  // Valeur pour l'axe X
-    int16_t y;  // Valeur pour l'axe Y
-    int16_t z;  // Valeur pour l'axe Z
+static const struct file_operations adxl345_merge_fops = {
+    .owner = THIS_MODULE,
+    .open = adxl345_merge_open,
+    .release = adxl345_merge_release,
+    .read_iter = adxl345_merge_read_iter,
+    .poll = adxl345_merge_poll,
 };
 
-struct adxl345_device
-{
-    struct miscdevice miscdev;
-    // FIFO pour stocker les échantillons
-    DECLARE_KFIFO(samples_fifo, struct adxl345_sample, 64);
-    wait_queue_head_t wait_queue;  // File d'attente pour les processus en sommeil
-    int current_axis; // 0 = X, 1 = Y, 2 = Z
-    struct mutex fifo_lock;  // Ajout du mutex
+static struct miscdevice adxl345_merge_miscdev = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = "adxl345-all",
+    .fops = &adxl345_merge_fops,
 };
 
-static int adxl345_count = 0;
+static ssize_t adaptive_watermark_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
 
-static long adxl345_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    struct adxl345_device *dev = file->private_data;
+    return sprintf(buf, "%d\n", READ_ONCE(dev->adaptive));
+}
 
-    pr_info("ADXL345_IOCTL received cmd: 0x%x, arg: %lu\n", cmd, arg);
+static ssize_t adaptive_watermark_store(struct device *d, struct device_attribute *attr,
+                                        const char *buf, size_t count)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
+    bool enable;
+    int ret;
 
-    switch (cmd) {
-    case ADXL345_SET_AXIS:
-        if (arg > 2) {
-            pr_err("Invalid axis: %lu\n", arg);
-            return -EINVAL;
-        }
-        dev->current_axis = arg;
-        pr_info("ADXL345 axis set to %lu\n", arg);
-        break;
+    ret = kstrtobool(buf, &enable);
+    if (ret)
+        return ret;
 
-    default:
-        pr_err("Unknown command: 0x%x\n", cmd);
-        return -ENOTTY; // Commande non supportée
-    }
+    WRITE_ONCE(dev->adaptive, enable);
+    return count;
+}
+static DEVICE_ATTR_RW(adaptive_watermark);
 
-    return 0;
+static ssize_t latency_budget_us_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
+
+    return sprintf(buf, "%llu\n", div_u64(READ_ONCE(dev->latency_budget_ns), NSEC_PER_USEC));
 }
 
-static ssize_t adxl345_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+static ssize_t latency_budget_us_store(struct device *d, struct device_attribute *attr,
+                                       const char *buf, size_t count)
 {
-    struct adxl345_device *dev = container_of(file->private_data, struct adxl345_device, miscdev);
-    // struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
-    struct adxl345_sample sample;
-    // int ret;
-
-    // pr_info("Start of reading\n");
-    // Attendre des données si la FIFO logicielle est vide
-    // ret = i2c_smbus_write_byte_data(client, 0x30, 0x04); // Simuler une interruption Watermark
-    if (kfifo_is_empty(&dev->samples_fifo)) {
-        if (wait_event_interruptible(dev->wait_queue, !kfifo_is_empty(&dev->samples_fifo)))
-            return -ERESTARTSYS; // Réessayer en cas de signal
-    }
-    // pr_info("Reading step 2\n");
-    // Récupérer un échantillon depuis la FIFO logicielle
-    mutex_lock(&dev->fifo_lock);
-    if (!kfifo_get(&dev->samples_fifo, &sample)){
-        mutex_unlock(&dev->fifo_lock);
-        return -EIO; // Erreur si impossible de récupérer les données
-    }
-    mutex_unlock(&dev->fifo_lock);
-    // pr_info("Reading step 3\n");
-    // Copier les données vers l'espace utilisateur
-    if (copy_to_user(buf, &sample, sizeof(sample)))
-        return -EFAULT;
-    // pr_info("Reading END\n");
-    return sizeof(sample);
+    struct adxl345_device *dev = dev_get_drvdata(d);
+    unsigned int us;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &us);
+    if (ret)
+        return ret;
+    if (!us)
+        return -EINVAL;
+
+    WRITE_ONCE(dev->latency_budget_ns, (u64)us * NSEC_PER_USEC);
+    return count;
 }
+static DEVICE_ATTR_RW(latency_budget_us);
 
-static const struct file_operations adxl345_fops = {
-    .owner = THIS_MODULE,
-    // .open = adxl345_open,
-    .read = adxl345_read,
-    .unlocked_ioctl = adxl345_ioctl, // Déclarez la fonction ioctl
+// Interruptions watermark par seconde au-delà desquelles la FIFO est scrutée
+static ssize_t poll_threshold_hz_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
+
+    return sprintf(buf, "%u\n", READ_ONCE(dev->poll_threshold_hz));
+}
+
+static ssize_t poll_threshold_hz_store(struct device *d, struct device_attribute *attr,
+                                       const char *buf, size_t count)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
+    unsigned int hz;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &hz);
+    if (ret)
+        return ret;
+
+    // Le prochain passage de poll_work revient aux interruptions si besoin
+    WRITE_ONCE(dev->poll_threshold_hz, hz);
+    return count;
+}
+static DEVICE_ATTR_RW(poll_threshold_hz);
+
+// Watermark effectivement programmé, choisi par ioctl ou par le mode adaptatif
+static ssize_t watermark_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
+
+    return sprintf(buf, "%u\n", READ_ONCE(dev->watermark));
+}
+static DEVICE_ATTR_RO(watermark);
+
+static const char * const adxl345_overrun_policies[] = {
+    [ADXL345_OVERRUN_OVERWRITE] = "overwrite",
+    [ADXL345_OVERRUN_DROP_NEWEST] = "drop-newest",
+    [ADXL345_OVERRUN_BACKPRESSURE] = "backpressure",
 };
 
-// static int adxl345_read_reg(struct i2c_client *client, u8 reg_addr, u8* value){
-//     int ret;
+static ssize_t overrun_policy_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
 
-//     // Écrire l'adresse du registre DEVID sur le bus I2C
-//     ret = i2c_master_send(client, &reg_addr, 1);
-//     if (ret < 0) {
-//         pr_err("Failed to set register address to ADXL345: %d\n", ret);
-//         return ret;
-//     }
+    return sprintf(buf, "%s\n", adxl345_overrun_policies[READ_ONCE(dev->overrun_policy)]);
+}
 
-//     // Lire la valeur du registre DEVID
-//     ret = i2c_master_recv(client, value, 1);
-//     if (ret < 0) {
-//         pr_err("Failed to read register from ADXL345: %d\n", ret);
-//         return ret;
-//     }
-//     return 0;
-// }
+static ssize_t overrun_policy_store(struct device *d, struct device_attribute *attr,
+                                    const char *buf, size_t count)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
+    int policy;
+
+    policy = sysfs_match_string(adxl345_overrun_policies, buf);
+    if (policy < 0)
+        return policy;
+
+    WRITE_ONCE(dev->overrun_policy, policy);
+    if (policy != ADXL345_OVERRUN_BACKPRESSURE)
+        adxl345_resume_stream(dev, true);
+    return count;
+}
+static DEVICE_ATTR_RW(overrun_policy);
 
-static int adxl345_read_fifo_sample(struct i2c_client *client, struct adxl345_sample *sample)
+static ssize_t dropped_samples_show(struct device *d, struct device_attribute *attr, char *buf)
 {
-    u8 reg_addr = 0x32;  // Adresse du premier registre de données (DATAX0)
-    u8 data[6];          // 6 octets pour X (2), Y (2) et Z (2)
-    int ret;
+    struct adxl345_device *dev = dev_get_drvdata(d);
 
-    // Écrire l'adresse du registre DATAX0
-    ret = i2c_master_send(client, &reg_addr, 1);
-    if (ret != 1) {
-        pr_err("Failed to set register address for FIFO read\n");
-        return -EIO;
-    }
+    return sprintf(buf, "%lld\n", atomic64_read(&dev->dropped));
+}
+static DEVICE_ATTR_RO(dropped_samples);
 
-    // Lire les 6 octets de la FIFO
-    ret = i2c_master_recv(client, data, 6);
-    if (ret != 6) {
-        pr_err("Failed to read sample data from FIFO\n");
-        return -EIO;
-    }
+static ssize_t overwritten_samples_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct adxl345_device *dev = dev_get_drvdata(d);
 
-    // Remplir la structure adxl345_sample avec les données reçues
-    sample->x = (data[1] << 8) | data[0];  // DATAX1 (MSB) et DATAX0 (LSB)
-    sample->y = (data[3] << 8) | data[2];  // DATAY1 (MSB) et DATAY0 (LSB)
-    sample->z = (data[5] << 8) | data[4];  // DATAZ1 (MSB) et DATAZ0 (LSB)
+    return sprintf(buf, "%lld\n", atomic64_read(&dev->overwritten));
+}
+static DEVICE_ATTR_RO(overwritten_samples);
+
+static struct attribute *adxl345_attrs[] = {
+    &dev_attr_adaptive_watermark.attr,
+    &dev_attr_latency_budget_us.attr,
+    &dev_attr_poll_threshold_hz.attr,
+    &dev_attr_watermark.attr,
+    &dev_attr_overrun_policy.attr,
+    &dev_attr_dropped_samples.attr,
+    &dev_attr_overwritten_samples.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(adxl345);
+
+static int adxl345_stats_show(struct seq_file *s, void *unused)
+{
+    struct adxl345_device *dev = s->private;
 
+    seq_printf(s, "irqs: %lld\n", atomic64_read(&dev->stats.irqs));
+    seq_printf(s, "samples_drained: %lld\n", atomic64_read(&dev->stats.drained));
+    seq_printf(s, "samples_delivered: %lld\n", atomic64_read(&dev->stats.delivered));
+    seq_printf(s, "samples_dropped: %lld\n", atomic64_read(&dev->dropped));
+    seq_printf(s, "samples_overwritten: %lld\n", atomic64_read(&dev->overwritten));
+    seq_printf(s, "i2c_errors: %lld\n", atomic64_read(&dev->stats.i2c_errors));
+    seq_printf(s, "events: %lld\n", atomic64_read(&dev->stats.events));
+    seq_printf(s, "captures: %lld\n", atomic64_read(&dev->stats.captures));
+    seq_printf(s, "polls: %lld\n", atomic64_read(&dev->stats.polls));
+    seq_printf(s, "polling: %d\n", READ_ONCE(dev->polling));
     return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(adxl345_stats);
 
-// static irqreturn_t adxl345_irq_handler(int irq, void *dev_id)
-// {
-//     struct adxl345_device *dev = dev_id;
-//     struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
-//     struct adxl345_sample sample;
-//     u8 fifo_status;
-//     int ret;
+// Une ligne par intervalle non vide : borne basse, borne haute, effectif
+static int adxl345_hist_show(struct seq_file *s, void *unused)
+{
+    struct adxl345_hist *h = s->private;
+    s64 count;
+    int b;
 
-//     // pr_info("Enter ADXL345 interrupt function\n");
+    for (b = 0; b < ADXL345_HIST_BUCKETS; b++) {
+        count = atomic64_read(&h->bucket[b]);
+        if (!count)
+            continue;
+        seq_printf(s, "%20llu %20llu %lld\n", b ? 1ULL << (b - 1) : 0,
+                   b < ADXL345_HIST_BUCKETS - 1 ? (1ULL << b) - 1 : U64_MAX, count);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(adxl345_hist);
 
-//     // Lire le registre FIFO_STATUS pour connaître le nombre d'échantillons
-//     ret = adxl345_read_reg(client, 0x39, &fifo_status);
-//     if (ret < 0) {
-//         pr_err("Failed to read FIFO_STATUS: %d\n", ret);
-//         return IRQ_NONE;
-//     }
+// Les erreurs de debugfs ne sont pas fatales : le pilote fonctionne sans
+static void adxl345_debugfs_init(struct adxl345_device *dev)
+{
+    dev->debugfs = debugfs_create_dir(dev->miscdev.name, NULL);
+    debugfs_create_file("stats", 0444, dev->debugfs, dev, &adxl345_stats_fops);
+    debugfs_create_file("irq_latency_ns", 0444, dev->debugfs,
+                        &dev->stats.irq_latency, &adxl345_hist_fops);
+    debugfs_create_file("i2c_transfer_ns", 0444, dev->debugfs,
+                        &dev->stats.i2c_time, &adxl345_hist_fops);
+    debugfs_create_file("fifo_entries", 0444, dev->debugfs,
+                        &dev->stats.fifo_entries, &adxl345_hist_fops);
+    debugfs_create_file("wakeup_latency_ns", 0444, dev->debugfs,
+                        &dev->stats.wakeup_latency, &adxl345_hist_fops);
+}
 
-//     // Vider la FIFO matérielle dans la FIFO logicielle
-//     while (fifo_status & 0x1F) { // FIFO Entries dans les 5 bits de poids faible
-//         ret = adxl345_read_fifo_sample(client, &sample);
-//         if (ret < 0) {
-//             pr_err("Failed to read sample from FIFO\n");
-//             break;
-//         }
+/*
+ * Configuration initiale depuis le device tree (propriétés optionnelles
+ * rate-hz, range-g, full-resolution, fifo-watermark, ring-entries et
+ * overrun-policy).
+ */
+static void adxl345_read_u8_property(struct device *d, const char *name, u8 *val)
+{
+    u32 v;
 
-//         if (!kfifo_put(&dev->samples_fifo, sample))
-//             pr_warn("Driver FIFO full, dropping sample\n");
+    if (!device_property_read_u32(d, name, &v))
+        *val = v;
+}
 
-//         fifo_status--;
-//     }
+// Détecteurs matériels, tous désactivés par défaut
+static int adxl345_parse_events(struct adxl345_device *dev, struct device *d)
+{
+    struct adxl345_events_config *ev = &dev->events;
 
-//     // Réveiller les processus en attente
-//     wake_up_interruptible(&dev->wait_queue);
+    device_property_read_u32(d, "events", &ev->enable);
+    if (ev->enable & ~ADXL345_EVENT_MASK) {
+        pr_err("Invalid ADXL345 events mask 0x%x in device tree\n", ev->enable);
+        return -EINVAL;
+    }
 
-//     return IRQ_HANDLED;
-// }
+    adxl345_read_u8_property(d, "tap-threshold", &ev->thresh_tap);
+    adxl345_read_u8_property(d, "tap-duration", &ev->tap_duration);
+    adxl345_read_u8_property(d, "tap-latency", &ev->tap_latency);
+    adxl345_read_u8_property(d, "tap-window", &ev->tap_window);
+    adxl345_read_u8_property(d, "tap-axes", &ev->tap_axes);
+    adxl345_read_u8_property(d, "activity-threshold", &ev->thresh_act);
+    adxl345_read_u8_property(d, "inactivity-threshold", &ev->thresh_inact);
+    adxl345_read_u8_property(d, "inactivity-time", &ev->time_inact);
+    adxl345_read_u8_property(d, "act-inact-ctl", &ev->act_inact_ctl);
+    adxl345_read_u8_property(d, "freefall-threshold", &ev->thresh_ff);
+    adxl345_read_u8_property(d, "freefall-time", &ev->time_ff);
 
-irqreturn_t adxl345_int(int irq, void *dev_id) {
-    struct adxl345_device *dev = (struct adxl345_device *)dev_id;
-    struct i2c_client *client = to_i2c_client(dev->miscdev.parent);
-    int ret, samples_count;
-    struct adxl345_sample sample;
-    // Lire le nombre d'échantillons disponibles dans FIFO_STATUS
-    u8 fifo_status_reg = 0x39; // Adresse du registre FIFO_STATUS
-    u8 fifo_status;
-    
-    ret = i2c_master_send(client, &fifo_status_reg, 1);
-    if (ret != 1) {
-        pr_err("Failed to send FIFO_STATUS register address\n");
-        return IRQ_HANDLED;
-    }
-    ret = i2c_master_recv(client, &fifo_status, 1);
-    if (ret != 1) {
-        pr_err("Failed to read FIFO_STATUS\n");
-        return IRQ_HANDLED;
+    return 0;
+}
+
+static int adxl345_parse_config(struct adxl345_device *dev, struct device *d, u32 *entries)
+{
+    u32 rate_hz = ADXL345_DEFAULT_RATE_HZ;
+    u32 range_g = ADXL345_DEFAULT_RANGE_G;
+    u32 watermark = ADXL345_DEFAULT_WATERMARK;
+    const char *policy;
+
+    *entries = READ_ONCE(ring_entries);
+
+    device_property_read_u32(d, "rate-hz", &rate_hz);
+    device_property_read_u32(d, "range-g", &range_g);
+    device_property_read_u32(d, "fifo-watermark", &watermark);
+    device_property_read_u32(d, "ring-entries", entries);
+
+    *entries = adxl345_ring_entries(*entries);
+    if (!rate_hz || rate_hz > ADXL345_RATE_HZ(ADXL345_RATE_MAX) ||
+        (range_g != 2 && range_g != 4 && range_g != 8 && range_g != 16) ||
+        !watermark || watermark > ADXL345_FIFO_SAMPLES_MASK || !*entries) {
+        pr_err("Invalid ADXL345 configuration in device tree\n");
+        return -EINVAL;
     }
-    samples_count = fifo_status & 0x3F; // Les 6 bits de poids faible
 
-    // Lire tous les échantillons disponibles
-    while (samples_count--) {
-        ret = adxl345_read_fifo_sample(client, &sample);
-        if (ret) {
-            pr_err("Failed to read FIFO sample\n");
-            break;
-        }
-        if (!kfifo_put(&dev->samples_fifo, sample)) {
-            // pr_err("Driver FIFO is full\n");
-            break;
+    dev->bw_rate = adxl345_rate_code(rate_hz);
+    dev->data_format = ilog2(range_g) - 1;
+    if (device_property_read_bool(d, "full-resolution"))
+        dev->data_format |= ADXL345_DATA_FORMAT_FULL_RES;
+    dev->fifo_ctl = ADXL345_FIFO_MODE_STREAM | watermark;
+
+    if (!device_property_read_string(d, "overrun-policy", &policy)) {
+        dev->overrun_policy = match_string(adxl345_overrun_policies,
+                                           ARRAY_SIZE(adxl345_overrun_policies), policy);
+        if (dev->overrun_policy < 0) {
+            pr_err("Invalid ADXL345 overrun-policy \"%s\"\n", policy);
+            return -EINVAL;
         }
     }
 
-    // Réveiller les processus en attente
-    wake_up(&dev->wait_queue);
+    if (adxl345_parse_events(dev, d))
+        return -EINVAL;
 
-    return IRQ_HANDLED;
+    // Capture déclenchée, désactivée par défaut
+    device_property_read_u32(d, "capture-trigger", &dev->capture.trigger);
+    device_property_read_u32(d, "capture-pre-samples", &dev->capture.pre_samples);
+    if (device_property_read_bool(d, "capture-stream"))
+        dev->capture.flags |= ADXL345_CAPTURE_STREAM;
+    if (dev->capture.trigger & ~ADXL345_EVENT_MASK || (dev->capture.trigger &&
+        (!dev->capture.pre_samples || dev->capture.pre_samples >= ADXL345_FIFO_SIZE))) {
+        pr_err("Invalid ADXL345 capture configuration in device tree\n");
+        return -EINVAL;
+    }
+
+    // Paramètres utilisés pour reconstituer l'horodatage de chaque échantillon
+    dev->odr_period_ns = ADXL345_ODR_PERIOD_NS(dev->bw_rate);
+    dev->watermark = watermark;
+    dev->latency_budget_ns = (u64)ADXL345_DEFAULT_LATENCY_US * NSEC_PER_USEC;
+    dev->poll_threshold_hz = ADXL345_DEFAULT_POLL_THRESHOLD_HZ;
+    device_property_read_u32(d, "poll-threshold-hz", &dev->poll_threshold_hz);
+
+    return 0;
+}
+
+static bool adxl345_writeable_reg(struct device *d, unsigned int reg)
+{
+    switch (reg) {
+    case ADXL345_REG_THRESH_TAP ... ADXL345_REG_TAP_AXES:
+    case ADXL345_REG_BW_RATE ... ADXL345_REG_INT_MAP:
+    case ADXL345_REG_DATA_FORMAT:
+    case ADXL345_REG_FIFO_CTL:
+        return true;
+    default:
+        return false;
+    }
 }
 
+static bool adxl345_readable_reg(struct device *d, unsigned int reg)
+{
+    return reg == ADXL345_REG_DEVID ||
+           (reg >= ADXL345_REG_THRESH_TAP && reg <= ADXL345_REG_FIFO_STATUS);
+}
+
+// Registres d'état et de données : jamais servis par le cache
+static bool adxl345_volatile_reg(struct device *d, unsigned int reg)
+{
+    switch (reg) {
+    case ADXL345_REG_ACT_TAP_STATUS:
+    case ADXL345_REG_INT_SOURCE:
+    case ADXL345_REG_DATAX0 ... ADXL345_REG_DATAZ1:
+    case ADXL345_REG_FIFO_STATUS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Lus, ils changent d'état : INT_SOURCE s'acquitte, DATA* dépile la FIFO
+static bool adxl345_precious_reg(struct device *d, unsigned int reg)
+{
+    return reg == ADXL345_REG_INT_SOURCE ||
+           (reg >= ADXL345_REG_DATAX0 && reg <= ADXL345_REG_DATAZ1);
+}
+
+/*
+ * Cache plat sur l'ensemble de la carte des registres. Sans table de valeurs
+ * par défaut, regmap initialise le cache en relisant le capteur, dont les
+ * registres survivent à un rechargement du module.
+ */
+static const struct regmap_config adxl345_regmap_config = {
+    .reg_bits = 8,
+    .val_bits = 8,
+    .max_register = ADXL345_REG_FIFO_STATUS,
+    .writeable_reg = adxl345_writeable_reg,
+    .readable_reg = adxl345_readable_reg,
+    .volatile_reg = adxl345_volatile_reg,
+    .precious_reg = adxl345_precious_reg,
+    .num_reg_defaults_raw = ADXL345_REG_FIFO_STATUS + 1,
+    .cache_type = REGCACHE_FLAT,
+};
+
 static int adxl345_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
     struct adxl345_device *dev;
+    u32 entries, autosuspend_ms = ADXL345_AUTOSUSPEND_MS;
     int ret;
 
     // Allouer la mémoire pour adxl345_device
@@ -229,71 +3800,131 @@ static int adxl345_probe(struct i2c_client *client, const struct i2c_device_id *
     dev->miscdev.parent = &client->dev;
     i2c_set_clientdata(client, dev);
 
-    mutex_init(&dev->fifo_lock);  // Initialisation du mutex
+    mutex_init(&dev->readers_lock);  // Initialisation du mutex
+    mutex_init(&dev->config_lock);
+    init_rwsem(&dev->ring_sem);
+    init_rwsem(&dev->remove_sem);
+    kref_init(&dev->ref);
+    spin_lock_init(&dev->event_lock);
+    spin_lock_init(&dev->capture_lock);
+    seqcount_init(&dev->latest_seq);
+    INIT_DELAYED_WORK(&dev->capture_work, adxl345_capture_work);
+    INIT_WORK(&dev->poll_work, adxl345_poll_work);
+    INIT_WORK(&dev->resume_work, adxl345_resume_work);
+    hrtimer_init(&dev->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->poll_timer.function = adxl345_poll_timer;
+    INIT_LIST_HEAD(&dev->readers);
+
+    // Initialiser la file d’attente avant que le périphérique puisse être ouvert
+    init_waitqueue_head(&dev->wait_queue);
+
+    dev->reg_datax0 = ADXL345_REG_DATAX0;
+    dev->reg_fifo_status = ADXL345_REG_FIFO_STATUS;
 
-    // Initialiser la FIFO
-    INIT_KFIFO(dev->samples_fifo);
+    dev->regmap = devm_regmap_init_i2c(client, &adxl345_regmap_config);
+    if (IS_ERR(dev->regmap)) {
+        pr_err("Failed to initialize regmap\n");
+        kfree(dev);
+        return PTR_ERR(dev->regmap);
+    }
+
+    ret = adxl345_parse_config(dev, &client->dev, &entries);
+    if (ret) {
+        kfree(dev);
+        return ret;
+    }
+
+    // Allouer l'anneau de diffusion, partagé avec l'espace utilisateur
+    ret = adxl345_ring_alloc(dev, entries);
+    if (ret) {
+        kfree(dev);
+        return ret;
+    }
 
     // Configurer la structure miscdevice
     dev->miscdev.minor = MISC_DYNAMIC_MINOR;
-    dev->miscdev.name = kasprintf(GFP_KERNEL, "adxl345-%d", adxl345_count++);
+    dev->index = adxl345_count++;
+    dev->miscdev.name = kasprintf(GFP_KERNEL, "adxl345-%d", dev->index);
     if (!dev->miscdev.name) {
+        vfree(dev->ring);
         kfree(dev);
         return -ENOMEM;
     }
     dev->miscdev.fops = &adxl345_fops;
 
+    /*
+     * Runtime PM : le capteur est actif pendant la sonde (référence prise
+     * ici, rendue à la fin), puis passe en veille après autosuspend-delay-ms
+     * sans fichier ouvert. Délai modifiable via power/autosuspend_delay_ms.
+     */
+    device_property_read_u32(&client->dev, "autosuspend-delay-ms", &autosuspend_ms);
+    pm_runtime_set_autosuspend_delay(&client->dev, autosuspend_ms);
+    pm_runtime_use_autosuspend(&client->dev);
+    pm_runtime_get_noresume(&client->dev);
+    pm_runtime_set_active(&client->dev);
+    pm_runtime_enable(&client->dev);
+
     // Enregistrer le périphérique auprès du framework misc
     ret = misc_register(&dev->miscdev);
     if (ret) {
         pr_err("Failed to register misc device\n");
+        pm_runtime_disable(&client->dev);
+        pm_runtime_set_suspended(&client->dev);
+        pm_runtime_put_noidle(&client->dev);
+        pm_runtime_dont_use_autosuspend(&client->dev);
         kfree(dev->miscdev.name);
+        vfree(dev->ring);
         kfree(dev);
         return ret;
     }
 
     // IITIALISATION DU CAPTEUR ADXL345
 
-    // Configuration du registre BW_RATE (fréquence de sortie des données : 100 Hz)
-    // ret = i2c_smbus_write_byte_data(client, 0x2C, 0x0A); // 0x0A = 100 Hz
-    // if (ret) {
-    //     pr_err("Failed to write BW_RATE register\n");
-    //     goto err_misc_deregister;
-    // }
+    // Configuration du registre BW_RATE (fréquence de sortie des données)
+    ret = regmap_write(dev->regmap, ADXL345_REG_BW_RATE, dev->bw_rate);
+    if (ret) {
+        pr_err("Failed to write BW_RATE register\n");
+        goto err_misc_deregister;
+    }
+
+    // Seuils des détecteurs matériels, avant d'activer leurs interruptions
+    ret = adxl345_write_events(dev, &dev->events);
+    if (ret) {
+        pr_err("Failed to write event detection registers\n");
+        goto err_misc_deregister;
+    }
 
-    // Activer l’interruption Watermark
-    ret = i2c_smbus_write_byte_data(client, 0x2E, 0x06); // INT_ENABLE: activer uniquement l'interruption Watermark (bit [2])
+    // Activer l’interruption Watermark et celles des détecteurs configurés
+    ret = regmap_write(dev->regmap, ADXL345_REG_INT_ENABLE,
+                       adxl345_int_enable(dev, dev->events.enable));
     if (ret) {
         pr_err("Failed to write INT_ENABLE register\n");
         goto err_misc_deregister;
     }
 
-    // Configuration du registre DATA_FORMAT (format de données par défaut)
-    // ret = i2c_smbus_write_byte_data(client, 0x31, 0x00); // 0x00 = format par défaut
-    // if (ret) {
-    //     pr_err("Failed to write DATA_FORMAT register\n");
-    //     goto err_misc_deregister;
-    // }
+    // Configuration du registre DATA_FORMAT (plage et résolution)
+    ret = regmap_write(dev->regmap, ADXL345_REG_DATA_FORMAT, dev->data_format);
+    if (ret) {
+        pr_err("Failed to write DATA_FORMAT register\n");
+        goto err_misc_deregister;
+    }
 
-    // Configurer le registre FIFO_CTL en mode Stream et définir le Watermark
-    ret = i2c_smbus_write_byte_data(client, 0x38, 0x68); // FIFO_CTL: mode Stream (bits [6:5] = 10) et Watermark = 20
+    // Configurer le registre FIFO_CTL en mode Stream et définir le Watermark (mode trigger en capture)
+    ret = adxl345_fifo_rearm(dev); // FIFO_CTL: mode Stream (bits [7:6] = 10) et Watermark
     if (ret) {
         pr_err("Failed to write FIFO_CTL register\n");
         goto err_misc_deregister;
     }
 
     // Configuration du registre POWER_CTL (mode mesure activé)
-    ret = i2c_smbus_write_byte_data(client, 0x2D, 0x08); // 0x08 = mode mesure
+    ret = regmap_write(dev->regmap, ADXL345_REG_POWER_CTL, ADXL345_POWER_CTL_MEASURE);
     if (ret) {
         pr_err("Failed to write POWER_CTL register\n");
         goto err_misc_deregister;
     }
 
-    // Initialiser la file d’attente pour la gestion des processus en sommeil
-    init_waitqueue_head(&dev->wait_queue);
-
     // Enregistrer un gestionnaire d'interruption avec Threaded IRQ
-    ret = devm_request_threaded_irq(&client->dev, client->irq, NULL,
+    ret = devm_request_threaded_irq(&client->dev, client->irq, adxl345_irq_edge,
                                 adxl345_int,
                                 IRQF_ONESHOT, dev->miscdev.name, dev);
     if (ret) {
@@ -303,14 +3934,32 @@ static int adxl345_probe(struct i2c_client *client, const struct i2c_device_id *
         pr_info("IRQ registered successfully, IRQ number: %d\n", client->irq);
     }
 
+    adxl345_debugfs_init(dev);
+
+    // Les fichiers /dev/adxl345-all ouverts ensuite incluront ce capteur
+    mutex_lock(&adxl345_devices_lock);
+    list_add_tail(&dev->node, &adxl345_devices);
+    mutex_unlock(&adxl345_devices_lock);
+
+    pm_runtime_mark_last_busy(&client->dev);
+    pm_runtime_put_autosuspend(&client->dev);
+
     pr_info("ADXL345 initialized successfully: ");
     pr_info("ADXL345 misc device registered as %s\n", dev->miscdev.name);
     return 0;
 
 err_misc_deregister:
     misc_deregister(&dev->miscdev);
-    kfree(dev->miscdev.name);
-    kfree(dev);
+    // Un fichier a pu être ouvert entre-temps : même retrait que adxl345_remove()
+    WRITE_ONCE(dev->dead, true);
+    adxl345_wake(dev);
+    down_write(&dev->remove_sem);
+    up_write(&dev->remove_sem);
+    pm_runtime_disable(&client->dev);
+    pm_runtime_set_suspended(&client->dev);
+    pm_runtime_put_noidle(&client->dev);
+    pm_runtime_dont_use_autosuspend(&client->dev);
+    kref_put(&dev->ref, adxl345_dev_free);
     return ret;
 }
 
@@ -321,20 +3970,152 @@ static int adxl345_remove(struct i2c_client *client)
     // Récupérer l'instance associée à i2c_client
     dev = i2c_get_clientdata(client);
 
-    // Désactiver le capteur (mode veille)
-    i2c_smbus_write_byte_data(client, 0x2D, 0x00); // 0x00 = mode veille
+    mutex_lock(&adxl345_devices_lock);
+    list_del(&dev->node);
+    adxl345_merge_remove(dev);
+    mutex_unlock(&adxl345_devices_lock);
+
+    debugfs_remove_recursive(dev->debugfs);
 
     // Désenregistrer le périphérique auprès du framework misc
     misc_deregister(&dev->miscdev);
 
-    // Libérer les ressources
-    kfree(dev->miscdev.name);
-    kfree(dev);
+    /*
+     * Les fichiers encore ouverts survivent au retrait : les lecteurs
+     * endormis sont réveillés, puis les opérations en cours attendues.
+     * Ensuite, plus aucune ne touche au capteur.
+     */
+    WRITE_ONCE(dev->dead, true);
+    adxl345_wake(dev);
+    down_write(&dev->remove_sem);
+    up_write(&dev->remove_sem);
+
+    // Plus d'interruption : rien ne peut relancer une capture ni la scrutation
+    disable_irq(client->irq);
+    cancel_delayed_work_sync(&dev->capture_work);
+
+    // poll_work ne relance plus la minuterie une fois la scrutation arrêtée
+    mutex_lock(&dev->config_lock);
+    adxl345_poll_stop(dev);
+    mutex_unlock(&dev->config_lock);
+    hrtimer_cancel(&dev->poll_timer);
+    cancel_work_sync(&dev->poll_work);
+    cancel_work_sync(&dev->resume_work);
+
+    // Désactiver le capteur (mode veille), s'il n'y est pas déjà
+    pm_runtime_disable(&client->dev);
+    if (!pm_runtime_status_suspended(&client->dev))
+        regmap_write(dev->regmap, ADXL345_REG_POWER_CTL, ADXL345_POWER_CTL_STANDBY);
+    pm_runtime_set_suspended(&client->dev);
+    pm_runtime_dont_use_autosuspend(&client->dev);
+
+    // Libérer les ressources, au dernier close() si des fichiers restent ouverts
+    kref_put(&dev->ref, adxl345_dev_free);
 
     pr_info("ADXL345 misc device unregistered\n");
     return 0;
 }
 
+/*
+ * Mise en veille (runtime PM, et veille système via pm_runtime_force_*) :
+ * l'interruption est masquée, la FIFO vidée, puis le capteur passe en
+ * veille sans que le cache ne l'enregistre (POWER_CTL y garde le mode
+ * mesure). Le cache seul reçoit ensuite les écritures jusqu'à la reprise :
+ * un capteur en veille ne coûte ni interruption ni transfert sur le bus.
+ */
+static int __maybe_unused adxl345_runtime_suspend(struct device *d)
+{
+    struct i2c_client *client = to_i2c_client(d);
+    struct adxl345_device *dev = i2c_get_clientdata(client);
+    int ret;
+
+    // Une capture en cours est abandonnée : la veille vide la FIFO
+    cancel_delayed_work_sync(&dev->capture_work);
+
+    mutex_lock(&dev->config_lock);
+    disable_irq(client->irq);
+    adxl345_drain(dev, 0);
+    dev->capture_state.armed = false;
+    dev->capture_state.pending = false;
+    // Reprise en interruptions : la scrutation se réenclenchera si besoin
+    adxl345_poll_stop(dev);
+
+    regcache_cache_bypass(dev->regmap, true);
+    ret = regmap_write(dev->regmap, ADXL345_REG_POWER_CTL, ADXL345_POWER_CTL_STANDBY);
+    regcache_cache_bypass(dev->regmap, false);
+    if (ret) {
+        enable_irq(client->irq);
+        mutex_unlock(&dev->config_lock);
+        return ret;
+    }
+
+    regcache_cache_only(dev->regmap, true);
+    mutex_unlock(&dev->config_lock);
+
+    return 0;
+}
+
+/*
+ * Réécrit un à un les registres de configuration depuis le cache, POWER_CTL
+ * excepté. regcache_sync_region() ne convient pas : sans cache marqué sale
+ * il ne fait rien, et marqué sale il saute les registres égaux à leur valeur
+ * par défaut, ici celle lue à la sonde et non celle d'un capteur remis sous
+ * tension. Les lectures sont servies par le cache, seules les écritures
+ * touchent le bus.
+ */
+static int adxl345_regs_restore(struct adxl345_device *dev)
+{
+    unsigned int reg, val;
+    int ret;
+
+    for (reg = ADXL345_REG_THRESH_TAP; reg <= ADXL345_REG_FIFO_CTL; reg++) {
+        if (reg == ADXL345_REG_POWER_CTL || !adxl345_writeable_reg(NULL, reg))
+            continue;
+        ret = regmap_read(dev->regmap, reg, &val);
+        if (!ret)
+            ret = regmap_write(dev->regmap, reg, val);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+ * Reprise : toute la configuration est réécrite depuis le cache, que le
+ * capteur ait conservé ses registres (veille) ou les ait perdus (coupure
+ * d'alimentation pendant la veille système). POWER_CTL vient en dernier,
+ * explicitement, pour que le capteur ne mesure qu'une fois configuré.
+ */
+static int __maybe_unused adxl345_runtime_resume(struct device *d)
+{
+    struct i2c_client *client = to_i2c_client(d);
+    struct adxl345_device *dev = i2c_get_clientdata(client);
+    int ret;
+
+    mutex_lock(&dev->config_lock);
+    regcache_cache_only(dev->regmap, false);
+    ret = adxl345_regs_restore(dev);
+    if (!ret)
+        ret = regmap_write(dev->regmap, ADXL345_REG_POWER_CTL, ADXL345_POWER_CTL_MEASURE);
+    // Un déclenchement antérieur à la veille resterait verrouillé
+    if (!ret && adxl345_capture_hw(dev))
+        ret = adxl345_fifo_rearm(dev);
+
+    // FIFO vidée avant la veille : le prochain front réancre les horodatages
+    dev->fifo_hint = 0;
+    enable_irq(client->irq);
+    mutex_unlock(&dev->config_lock);
+
+    if (ret)
+        pr_err("Failed to restore ADXL345 registers: %d\n", ret);
+    return ret;
+}
+
+static const struct dev_pm_ops adxl345_pm_ops = {
+    SET_SYSTEM_SLEEP_PM_OPS(pm_runtime_force_suspend, pm_runtime_force_resume)
+    SET_RUNTIME_PM_OPS(adxl345_runtime_suspend, adxl345_runtime_resume, NULL)
+};
+
 /* La liste suivante permet l'association entre un périphérique et son
    pilote dans le cas d'une initialisation statique sans utilisation de
    device tree.
@@ -377,6 +4158,8 @@ static struct i2c_driver adxl345_driver = {
            et ne doit pas contenir d'espace */
         .name   = "adxl345",
         .of_match_table = of_match_ptr(adxl345_of_match),
+        .dev_groups = adxl345_groups,
+        .pm = &adxl345_pm_ops,
     },
 
     .id_table       = adxl345_idtable,
@@ -384,7 +4167,31 @@ static struct i2c_driver adxl345_driver = {
     .remove         = adxl345_remove,
 };
 
-module_i2c_driver(adxl345_driver);
+// Le flux fusionné existe indépendamment des capteurs sondés
+static int __init adxl345_init(void)
+{
+    int ret;
+
+    ret = misc_register(&adxl345_merge_miscdev);
+    if (ret) {
+        pr_err("Failed to register %s\n", adxl345_merge_miscdev.name);
+        return ret;
+    }
+
+    ret = i2c_add_driver(&adxl345_driver);
+    if (ret)
+        misc_deregister(&adxl345_merge_miscdev);
+    return ret;
+}
+
+static void __exit adxl345_exit(void)
+{
+    i2c_del_driver(&adxl345_driver);
+    misc_deregister(&adxl345_merge_miscdev);
+}
+
+module_init(adxl345_init);
+module_exit(adxl345_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("adxl345 driver");
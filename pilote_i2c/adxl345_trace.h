@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Points de trace du pilote ADXL345, visibles dans
+ * /sys/kernel/tracing/events/adxl345/ (ftrace, perf, trace-cmd).
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM adxl345
+
+#if !defined(_ADXL345_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _ADXL345_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// Une vidange de la FIFO matérielle (interruption ou reconfiguration)
+TRACE_EVENT(adxl345_drain,
+    TP_PROTO(const char *name, unsigned int fifo_entries, int drained,
+             unsigned int left, u64 bus_ns, s64 irq_latency_ns),
+    TP_ARGS(name, fifo_entries, drained, left, bus_ns, irq_latency_ns),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(unsigned int, fifo_entries)
+        __field(int, drained)
+        __field(unsigned int, left)
+        __field(u64, bus_ns)
+        __field(s64, irq_latency_ns)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name, name);
+        __entry->fifo_entries = fifo_entries;
+        __entry->drained = drained;
+        __entry->left = left;
+        __entry->bus_ns = bus_ns;
+        __entry->irq_latency_ns = irq_latency_ns;
+    ),
+
+    TP_printk("%s fifo_entries=%u drained=%d left=%u bus_ns=%llu irq_latency_ns=%lld",
+              __get_str(name), __entry->fifo_entries, __entry->drained,
+              __entry->left, __entry->bus_ns, __entry->irq_latency_ns)
+);
+
+// Lot publié dans l'anneau de diffusion
+TRACE_EVENT(adxl345_ring_push,
+    TP_PROTO(const char *name, u32 head, unsigned int count),
+    TP_ARGS(name, head, count),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(u32, head)
+        __field(unsigned int, count)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name, name);
+        __entry->head = head;
+        __entry->count = count;
+    ),
+
+    TP_printk("%s head=%u count=%u", __get_str(name), __entry->head, __entry->count)
+);
+
+// Échantillons jetés par le pilote (drop-newest, pause de la FIFO)
+TRACE_EVENT(adxl345_ring_drop,
+    TP_PROTO(const char *name, int policy, u32 count),
+    TP_ARGS(name, policy, count),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(int, policy)
+        __field(u32, count)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name, name);
+        __entry->policy = policy;
+        __entry->count = count;
+    ),
+
+    TP_printk("%s policy=%d count=%u", __get_str(name), __entry->policy, __entry->count)
+);
+
+// Échantillons écrasés avant d'être lus par un fichier
+TRACE_EVENT(adxl345_ring_overwrite,
+    TP_PROTO(const char *name, const void *file, u32 count),
+    TP_ARGS(name, file, count),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(const void *, file)
+        __field(u32, count)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name, name);
+        __entry->file = file;
+        __entry->count = count;
+    ),
+
+    TP_printk("%s file=%p count=%u", __get_str(name), __entry->file, __entry->count)
+);
+
+// Fin d'un read() : temps passé à attendre et échantillons retournés
+TRACE_EVENT(adxl345_read,
+    TP_PROTO(const char *name, const void *file, u64 wait_ns, ssize_t samples),
+    TP_ARGS(name, file, wait_ns, samples),
+
+    TP_STRUCT__entry(
+        __string(name, name)
+        __field(const void *, file)
+        __field(u64, wait_ns)
+        __field(ssize_t, samples)
+    ),
+
+    TP_fast_assign(
+        __assign_str(name, name);
+        __entry->file = file;
+        __entry->wait_ns = wait_ns;
+        __entry->samples = samples;
+    ),
+
+    TP_printk("%s file=%p wait_ns=%llu samples=%zd", __get_str(name), __entry->file,
+              __entry->wait_ns, __entry->samples)
+);
+
+#endif /* _ADXL345_TRACE_H */
+
+// Ce fichier est hors de include/trace/events : le chercher à côté du pilote
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE adxl345_trace
+#include <trace/define_trace.h>
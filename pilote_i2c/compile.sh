@@ -19,6 +19,15 @@ make CROSS_COMPILE=arm-linux-gnueabihf- ARCH=arm KDIR=../linux-5.10.19/build/
 # Compile test_adxl
 arm-linux-gnueabihf-gcc -Wall -o test_adxl test_adxl_concurrence.c
 
+# Compile stress test
+arm-linux-gnueabihf-gcc -Wall -pthread -o test_adxl_stress test_adxl_stress.c
+
+# Compile event reader
+arm-linux-gnueabihf-gcc -Wall -o test_adxl_events test_adxl_events.c
+
+# Compile merged stream reader
+arm-linux-gnueabihf-gcc -Wall -o test_adxl_merge test_adxl_merge.c
+
 # Compile main
 arm-linux-gnueabihf-gcc -Wall -o main main.c
 
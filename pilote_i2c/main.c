@@ -3,6 +3,8 @@
 #include <unistd.h>
 #include <string.h>
 
+#define MAX_SAMPLES 64
+
 struct adxl345_sample {
     short x;
     short y;
@@ -15,15 +17,17 @@ int main() {
         perror("Failed to open device");
         return -1;
     }
-    struct adxl345_sample sample;
+    // Un seul read() récupère tous les échantillons disponibles
+    struct adxl345_sample samples[MAX_SAMPLES];
     while (1) {
-        int ret = read(fd, &sample, sizeof(sample));
+        int ret = read(fd, samples, sizeof(samples));
         if (ret < 0) {
             perror("Failed to read data");
             close(fd);
             return -1;
         }
-        printf("X: %d, Y: %d, Z: %d\n", sample.x, sample.y, sample.z);
+        for (int i = 0; i < ret / (int)sizeof(samples[0]); i++)
+            printf("X: %d, Y: %d, Z: %d\n", samples[i].x, samples[i].y, samples[i].z);
         usleep(500000); // Attendre 500 ms pour lire les données suivantes
     }
 
@@ -1,34 +1,66 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <stdlib.h>
 
-void read_sensor(const char *device) {
-    int fd = open(device, O_RDONLY);
-    if (fd < 0) {
-        perror("Failed to open device");
-        return;
-    }
+#define NB_SENSORS 2
+
+static const char *devices[NB_SENSORS] = {
+    "/dev/adxl345-0",
+    "/dev/adxl345-1",
+};
 
+int read_sensor(int fd, const char *device) {
     char buffer[16];
     int ret = read(fd, buffer, sizeof(buffer));
     if (ret < 0) {
         perror("Read failed");
-    } else {
-        printf("Data from %s: ", device);
-        for (int i = 0; i < ret; i++) {
-            printf("%02x ", buffer[i]);
-        }
-        printf("\n");
+        return -1;
     }
 
-    close(fd);
+    printf("Data from %s: ", device);
+    for (int i = 0; i < ret; i++) {
+        printf("%02x ", buffer[i]);
+    }
+    printf("\n");
+    return 0;
 }
 
 int main() {
+    struct pollfd fds[NB_SENSORS];
+    int pending = NB_SENSORS;
+
     printf("Reading from ADXL345 sensors...\n");
-    read_sensor("/dev/adxl345-0");
-    read_sensor("/dev/adxl345-1");
+
+    // Un seul thread surveille tous les capteurs avec poll()
+    for (int i = 0; i < NB_SENSORS; i++) {
+        fds[i].fd = open(devices[i], O_RDONLY | O_NONBLOCK);
+        if (fds[i].fd < 0) {
+            perror("Failed to open device");
+            return -1;
+        }
+        fds[i].events = POLLIN;
+    }
+
+    while (pending > 0) {
+        if (poll(fds, NB_SENSORS, -1) < 0) {
+            perror("Poll failed");
+            break;
+        }
+        for (int i = 0; i < NB_SENSORS; i++) {
+            if (fds[i].revents & POLLERR)
+                printf("Overrun on %s\n", devices[i]);
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            read_sensor(fds[i].fd, devices[i]);
+            fds[i].fd = -fds[i].fd - 1; // Capteur lu : poll() l'ignore désormais
+            pending--;
+        }
+    }
+
+    for (int i = 0; i < NB_SENSORS; i++)
+        close(fds[i].fd < 0 ? -fds[i].fd - 1 : fds[i].fd);
     return 0;
 }
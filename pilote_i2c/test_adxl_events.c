@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+/*
+ * Lecteur d'événements : active la détection de tap, d'activité et de chute
+ * libre, puis dort dans poll() jusqu'au prochain événement, sans lire le
+ * flux d'échantillons.
+ */
+
+#define ADXL345_IOC_MAGIC 'a'
+#define ADXL345_SET_FORMAT _IOW(ADXL345_IOC_MAGIC, 3, int)
+#define ADXL345_SET_EVENTS _IOW(ADXL345_IOC_MAGIC, 14, struct adxl345_events_config)
+#define ADXL345_FORMAT_EVENTS 3
+
+#define ADXL345_EVENT_SINGLE_TAP 0x40
+#define ADXL345_EVENT_DOUBLE_TAP 0x20
+#define ADXL345_EVENT_ACTIVITY   0x10
+#define ADXL345_EVENT_FREE_FALL  0x04
+
+struct adxl345_events_config {
+    uint32_t enable;
+    uint8_t thresh_tap;
+    uint8_t tap_duration;
+    uint8_t tap_latency;
+    uint8_t tap_window;
+    uint8_t tap_axes;
+    uint8_t thresh_act;
+    uint8_t thresh_inact;
+    uint8_t time_inact;
+    uint8_t act_inact_ctl;
+    uint8_t thresh_ff;
+    uint8_t time_ff;
+    uint8_t reserved;
+};
+
+struct adxl345_event {
+    int64_t timestamp;
+    uint32_t seq;
+    uint8_t source;
+    uint8_t act_tap_status;
+    uint16_t reserved;
+};
+
+int main(int argc, char *argv[]) {
+    const char *device = argc > 1 ? argv[1] : "/dev/adxl345-0";
+    struct adxl345_events_config cfg = {
+        .enable = ADXL345_EVENT_SINGLE_TAP | ADXL345_EVENT_DOUBLE_TAP |
+                  ADXL345_EVENT_ACTIVITY | ADXL345_EVENT_FREE_FALL,
+        .thresh_tap = 48,       // 3 g
+        .tap_duration = 32,     // 20 ms
+        .tap_latency = 16,      // 20 ms
+        .tap_window = 200,      // 250 ms
+        .tap_axes = 0x07,       // X, Y et Z
+        .thresh_act = 16,       // 1 g
+        .act_inact_ctl = 0x70,  // Activité en DC sur X, Y et Z
+        .thresh_ff = 7,         // 437,5 mg
+        .time_ff = 40,          // 200 ms
+    };
+    struct adxl345_event events[16];
+    struct pollfd pfd;
+    int fd, ret;
+
+    fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+    if (ioctl(fd, ADXL345_SET_EVENTS, &cfg) < 0 ||
+        ioctl(fd, ADXL345_SET_FORMAT, ADXL345_FORMAT_EVENTS) < 0) {
+        perror("Failed to configure events");
+        close(fd);
+        return 1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    printf("Waiting for events on %s...\n", device);
+
+    while (1) {
+        if (poll(&pfd, 1, -1) < 0) {
+            perror("Poll failed");
+            break;
+        }
+        if (pfd.revents & POLLERR)
+            printf("Events lost\n");
+
+        ret = read(fd, events, sizeof(events));
+        if (ret < 0) {
+            perror("Read failed");
+            break;
+        }
+        for (int i = 0; i < ret / (int)sizeof(events[0]); i++) {
+            printf("[%lld.%09lld] #%u%s%s%s%s (status 0x%02x)\n",
+                   (long long)(events[i].timestamp / 1000000000),
+                   (long long)(events[i].timestamp % 1000000000), events[i].seq,
+                   events[i].source & ADXL345_EVENT_SINGLE_TAP ? " single-tap" : "",
+                   events[i].source & ADXL345_EVENT_DOUBLE_TAP ? " double-tap" : "",
+                   events[i].source & ADXL345_EVENT_ACTIVITY ? " activity" : "",
+                   events[i].source & ADXL345_EVENT_FREE_FALL ? " free-fall" : "",
+                   events[i].act_tap_status);
+        }
+    }
+
+    close(fd);
+    return 0;
+}
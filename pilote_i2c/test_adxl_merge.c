@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Lecture du flux fusionné : un seul fichier, un seul thread, les
+ * échantillons de tous les capteurs déjà triés par horodatage.
+ */
+
+#define ADXL345_SAMPLE_OVERRUN 0x0001
+#define ADXL345_SAMPLE_LATE    0x0002
+
+struct adxl345_sample_merged {
+    int64_t timestamp;
+    uint32_t seq;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint16_t flags;
+    uint32_t source;
+};
+
+int main(int argc, char *argv[]) {
+    const char *device = argc > 1 ? argv[1] : "/dev/adxl345-all";
+    struct adxl345_sample_merged samples[64];
+    int fd, ret;
+
+    fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    printf("Reading merged stream from %s...\n", device);
+    while (1) {
+        ret = read(fd, samples, sizeof(samples));
+        if (ret < 0) {
+            perror("Read failed");
+            break;
+        }
+        for (int i = 0; i < ret / (int)sizeof(samples[0]); i++) {
+            printf("[%lld.%09lld] adxl345-%u #%u: x=%d y=%d z=%d%s%s\n",
+                   (long long)(samples[i].timestamp / 1000000000),
+                   (long long)(samples[i].timestamp % 1000000000),
+                   samples[i].source, samples[i].seq,
+                   samples[i].x, samples[i].y, samples[i].z,
+                   samples[i].flags & ADXL345_SAMPLE_OVERRUN ? " (overrun)" : "",
+                   samples[i].flags & ADXL345_SAMPLE_LATE ? " (late)" : "");
+        }
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+/*
+ * Test de charge de l'anneau de diffusion : plusieurs fichiers ouverts sur
+ * le même capteur, chacun lu par son propre thread, plus un fichier partagé
+ * par deux threads. À la fin, on vérifie que :
+ *  - chaque flux a des numéros de séquence strictement croissants
+ *    (les trous correspondent à des échantillons perdus, pas à des erreurs,
+ *    et l'échantillon qui suit un trou porte ADXL345_SAMPLE_OVERRUN) ;
+ *  - les threads qui partagent un fichier n'ont jamais reçu le même
+ *    échantillon ;
+ *  - un même numéro de séquence porte les mêmes valeurs dans tous les flux
+ *    (sinon l'échantillon a été lu pendant sa réécriture).
+ * Un troisième argument choisit la politique de débordement (sysfs
+ * overrun_policy). En backpressure, aucun trou n'est toléré : le pilote ne
+ * doit jamais écarter un échantillon déjà publié.
+ */
+
+#define ADXL345_IOC_MAGIC 'a'
+#define ADXL345_SET_FORMAT _IOW(ADXL345_IOC_MAGIC, 3, int)
+#define ADXL345_FORMAT_EXT 1
+#define ADXL345_SAMPLE_OVERRUN 0x0001
+
+#define NB_SOLO         3
+#define NB_SHARED       2
+#define NB_STREAMS      (NB_SOLO + NB_SHARED)
+#define READ_SAMPLES    64
+#define MAX_RECORDS     (1 << 16)
+
+struct adxl345_sample_ext {
+    int64_t timestamp;
+    uint32_t seq;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint16_t flags;
+    uint32_t reserved;
+};
+
+struct stream {
+    pthread_t thread;
+    int fd;
+    struct adxl345_sample_ext *records;
+    size_t count;
+    size_t gaps;
+    size_t errors;
+};
+
+static struct stream streams[NB_STREAMS];
+static time_t deadline;
+
+// Écrit la politique de débordement dans /sys/class/misc/<capteur>/device
+static int set_policy(const char *device, const char *policy) {
+    const char *name = strrchr(device, '/');
+    char path[128];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/class/misc/%s/device/overrun_policy",
+             name ? name + 1 : device);
+    f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "%s\n", policy);
+    return fclose(f);
+}
+
+static void *reader(void *arg) {
+    struct stream *s = arg;
+    struct adxl345_sample_ext buf[READ_SAMPLES];
+
+    while (time(NULL) < deadline && s->count + READ_SAMPLES <= MAX_RECORDS) {
+        int ret = read(s->fd, buf, sizeof(buf));
+        if (ret < 0) {
+            perror("Read failed");
+            s->errors++;
+            break;
+        }
+        if (ret % sizeof(buf[0])) {
+            fprintf(stderr, "Partial record returned (%d bytes)\n", ret);
+            s->errors++;
+        }
+        for (int i = 0; i < ret / (int)sizeof(buf[0]); i++) {
+            // Les séquences d'un même read() sont strictement croissantes
+            if (i > 0 && (int32_t)(buf[i].seq - buf[i - 1].seq) <= 0) {
+                fprintf(stderr, "Out of order seq %u after %u\n", buf[i].seq, buf[i - 1].seq);
+                s->errors++;
+            }
+            if (i > 0 && buf[i].timestamp <= buf[i - 1].timestamp) {
+                fprintf(stderr, "Timestamp going backwards at seq %u\n", buf[i].seq);
+                s->errors++;
+            }
+            s->records[s->count++] = buf[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int cmp_seq(const void *a, const void *b) {
+    const struct adxl345_sample_ext *ra = a, *rb = b;
+    return (int32_t)(ra->seq - rb->seq) < 0 ? -1 : ra->seq != rb->seq;
+}
+
+static int same_values(const struct adxl345_sample_ext *a, const struct adxl345_sample_ext *b) {
+    return a->timestamp == b->timestamp && a->x == b->x && a->y == b->y && a->z == b->z;
+}
+
+// Compare deux flux triés sur leurs numéros de séquence communs
+static size_t cross_check(const struct adxl345_sample_ext *a, size_t na,
+                          const struct adxl345_sample_ext *b, size_t nb) {
+    size_t i = 0, j = 0, errors = 0;
+
+    while (i < na && j < nb) {
+        int32_t d = (int32_t)(a[i].seq - b[j].seq);
+        if (d < 0) {
+            i++;
+        } else if (d > 0) {
+            j++;
+        } else {
+            if (!same_values(&a[i], &b[j])) {
+                fprintf(stderr, "Torn sample: seq %u differs between readers\n", a[i].seq);
+                errors++;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = argc > 1 ? argv[1] : "/dev/adxl345-0";
+    int duration = argc > 2 ? atoi(argv[2]) : 10;
+    const char *policy = argc > 3 ? argv[3] : NULL;
+    int lossless = policy && !strcmp(policy, "backpressure");
+    struct adxl345_sample_ext *shared;
+    size_t errors = 0, nshared = 0;
+    int shared_fd;
+
+    printf("Stress test on %s for %d s...\n", device, duration);
+    if (policy && set_policy(device, policy) < 0)
+        return 1;
+
+    shared_fd = open(device, O_RDONLY);
+    if (shared_fd < 0 || ioctl(shared_fd, ADXL345_SET_FORMAT, ADXL345_FORMAT_EXT) < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    for (int i = 0; i < NB_STREAMS; i++) {
+        streams[i].records = malloc(MAX_RECORDS * sizeof(struct adxl345_sample_ext));
+        if (!streams[i].records) {
+            perror("malloc");
+            return 1;
+        }
+        if (i >= NB_SOLO) {
+            streams[i].fd = shared_fd;
+            continue;
+        }
+        streams[i].fd = open(device, O_RDONLY);
+        if (streams[i].fd < 0 || ioctl(streams[i].fd, ADXL345_SET_FORMAT, ADXL345_FORMAT_EXT) < 0) {
+            perror("Failed to open device");
+            return 1;
+        }
+    }
+
+    deadline = time(NULL) + duration;
+    for (int i = 0; i < NB_STREAMS; i++)
+        pthread_create(&streams[i].thread, NULL, reader, &streams[i]);
+    for (int i = 0; i < NB_STREAMS; i++)
+        pthread_join(streams[i].thread, NULL);
+
+    // Flux des lecteurs seuls : séquences strictement croissantes d'un read() à l'autre
+    for (int i = 0; i < NB_SOLO; i++) {
+        struct stream *s = &streams[i];
+        for (size_t k = 1; k < s->count; k++) {
+            int32_t d = (int32_t)(s->records[k].seq - s->records[k - 1].seq);
+            if (d <= 0) {
+                fprintf(stderr, "Duplicate or reordered seq %u on reader %d\n", s->records[k].seq, i);
+                s->errors++;
+            } else if (d > 1) {
+                s->gaps += d - 1;
+                if (lossless) {
+                    fprintf(stderr, "Gap before seq %u on reader %d under backpressure\n",
+                            s->records[k].seq, i);
+                    s->errors++;
+                }
+                if (!(s->records[k].flags & ADXL345_SAMPLE_OVERRUN)) {
+                    fprintf(stderr, "Gap before seq %u not flagged on reader %d\n", s->records[k].seq, i);
+                    s->errors++;
+                }
+            }
+        }
+    }
+
+    // Fichier partagé : l'union des deux threads ne doit contenir aucun doublon
+    shared = malloc(NB_SHARED * MAX_RECORDS * sizeof(struct adxl345_sample_ext));
+    if (!shared) {
+        perror("malloc");
+        return 1;
+    }
+    for (int i = NB_SOLO; i < NB_STREAMS; i++) {
+        memcpy(shared + nshared, streams[i].records, streams[i].count * sizeof(*shared));
+        nshared += streams[i].count;
+    }
+    qsort(shared, nshared, sizeof(*shared), cmp_seq);
+    for (size_t k = 1; k < nshared; k++) {
+        if (shared[k].seq == shared[k - 1].seq) {
+            fprintf(stderr, "Sample %u delivered twice on the shared file\n", shared[k].seq);
+            errors++;
+        }
+    }
+
+    // Valeurs identiques pour un même échantillon dans tous les flux
+    for (int i = 0; i < NB_SOLO; i++) {
+        for (int j = i + 1; j < NB_SOLO; j++)
+            errors += cross_check(streams[i].records, streams[i].count,
+                                  streams[j].records, streams[j].count);
+        errors += cross_check(streams[i].records, streams[i].count, shared, nshared);
+    }
+
+    for (int i = 0; i < NB_STREAMS; i++) {
+        printf("Reader %d (%s): %zu samples, %zu lost, %zu errors\n", i,
+               i < NB_SOLO ? "own file" : "shared file",
+               streams[i].count, streams[i].gaps, streams[i].errors);
+        errors += streams[i].errors;
+    }
+    printf("%s: %zu errors\n", errors ? "FAILED" : "PASSED", errors);
+
+    for (int i = 0; i < NB_SOLO; i++)
+        close(streams[i].fd);
+    close(shared_fd);
+    return errors ? 1 : 0;
+}